@@ -0,0 +1,494 @@
+#include "AsyncRouter.hpp"
+#include "RouteStats.hpp"
+#include <deque>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+
+// One request in flight
+struct AsyncRoute
+{
+    RoutingResult result;
+    RoutePlan plan;
+    RouteStep step;
+    AsyncRouter::Callback callback;
+    void* context;
+    const std::string* path; // being probed: result.file_path or plan.index_path
+    FileProbe probe;         // filled by the backend
+    struct statx stx;        // io_uring writes here
+    bool opening;            // io_uring: the statx is done, an openat tells readability the mode bits can't
+};
+
+// Where probes are sent: submit() never blocks, reap() hands back the finished ones
+class ProbeBackend
+{
+public:
+    virtual ~ProbeBackend() {}
+    virtual void submit(AsyncRoute* route) = 0;
+    virtual void reap(std::vector<AsyncRoute*>& done) = 0;
+};
+
+static void signal(int fd) {
+    uint64_t one = 1;
+    ssize_t n = write(fd, &one, sizeof(one));
+    (void)n; // a full counter is still readable, nothing to do
+}
+
+static ProbeBackend* threadBackend(size_t threads, int event);
+
+// ---- io_uring backend: one IORING_OP_STATX per probe, completions signal the eventfd ----
+    // when the mode bits can't tell readability (groups, ACLs) an IORING_OP_OPENAT follows: access() would block
+
+class UringBackend : public ProbeBackend
+{
+public:
+    static UringBackend* create(unsigned int entries, int event);
+    ~UringBackend();
+
+    void submit(AsyncRoute* route);
+    void reap(std::vector<AsyncRoute*>& done);
+
+private:
+    int _ring;
+    void* _sq;
+    size_t _sqSize;
+    void* _cq;
+    size_t _cqSize;
+    struct io_uring_sqe* _sqes;
+    size_t _sqesSize;
+
+    unsigned int* _sqHead;
+    unsigned int* _sqTail;
+    unsigned int _sqMask;
+    unsigned int* _sqArray;
+    unsigned int* _cqHead;
+    unsigned int* _cqTail;
+    unsigned int _cqMask;
+    struct io_uring_cqe* _cqes;
+
+    unsigned int _sqEntries;
+    unsigned int _cqEntries;
+    size_t _inflight;
+    std::deque<AsyncRoute*> _backlog; // waiting for room in the rings
+    int _event;
+    ProbeBackend* _fallback; // threads for what the kernel refuses with nothing in flight, started on first use
+
+    UringBackend();
+    bool push(AsyncRoute* route);
+    void collect(std::vector<AsyncRoute*>* done);
+};
+
+UringBackend::UringBackend()
+    : _ring(-1), _sq(MAP_FAILED), _sqSize(0), _cq(MAP_FAILED), _cqSize(0), _sqes(NULL), _sqesSize(0),
+      _sqHead(NULL), _sqTail(NULL), _sqMask(0), _sqArray(NULL), _cqHead(NULL), _cqTail(NULL), _cqMask(0),
+      _cqes(NULL), _sqEntries(0), _cqEntries(0), _inflight(0), _event(-1), _fallback(NULL) {}
+
+// DO: Set up a ring and check that it can run statx
+// RETURN: NULL if io_uring is not usable here (old kernel, seccomp...): the caller falls back to threads
+UringBackend* UringBackend::create(unsigned int entries, int event) {
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    int ring = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring < 0)
+        return NULL;
+
+    UringBackend* b = new UringBackend();
+    b->_ring = ring;
+    b->_event = event;
+    b->_sqEntries = params.sq_entries;
+    b->_cqEntries = params.cq_entries;
+
+    b->_sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    b->_cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (b->_cqSize > b->_sqSize)
+            b->_sqSize = b->_cqSize;
+        b->_cqSize = b->_sqSize;
+    }
+    b->_sq = mmap(NULL, b->_sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+    if (b->_sq == MAP_FAILED)
+    {
+        delete b;
+        return NULL;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        b->_cq = b->_sq;
+    else
+        b->_cq = mmap(NULL, b->_cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+    b->_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(NULL, b->_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+    if (b->_cq == MAP_FAILED || sqes == MAP_FAILED)
+    {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, b->_sqesSize);
+        delete b;
+        return NULL;
+    }
+    b->_sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(b->_sq);
+    char* cq = static_cast<char*>(b->_cq);
+    b->_sqHead = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+    b->_sqTail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+    b->_sqMask = *reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+    b->_sqArray = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+    b->_cqHead = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+    b->_cqTail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+    b->_cqMask = *reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+    b->_cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // statx and openat need Linux 5.6: ask the kernel before relying on them
+    size_t probeSize = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    std::vector<char> probeBuffer(probeSize, 0);
+    struct io_uring_probe* probe = reinterpret_cast<struct io_uring_probe*>(&probeBuffer[0]);
+    if (syscall(__NR_io_uring_register, ring, IORING_REGISTER_PROBE, probe, 256) < 0
+        || probe->last_op < IORING_OP_STATX
+        || !(probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED)
+        || !(probe->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED)
+        || syscall(__NR_io_uring_register, ring, IORING_REGISTER_EVENTFD, &event, 1) < 0)
+    {
+        delete b;
+        return NULL;
+    }
+    return b;
+}
+
+UringBackend::~UringBackend()
+{
+    // the kernel still writes into the statx buffers of what is in flight: wait for it
+    while (_inflight && _ring >= 0)
+    {
+        if (syscall(__NR_io_uring_enter, _ring, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+            break;
+        collect(NULL);
+    }
+    for (size_t i = 0; i < _backlog.size(); ++i)
+        delete _backlog[i];
+    delete _fallback;
+    if (_sqes)
+        munmap(_sqes, _sqesSize);
+    if (_cq != MAP_FAILED && _cq != _sq)
+        munmap(_cq, _cqSize);
+    if (_sq != MAP_FAILED)
+        munmap(_sq, _sqSize);
+    if (_ring >= 0)
+        close(_ring);
+}
+
+// DO: Queue one statx (or openat) in the submission ring and tell the kernel
+// RETURN: false when the rings are full, or the kernel refused the submit while others are in flight:
+    // the route waits in the backlog, pushed again once a completion is reaped
+    // refused with nothing in flight there is no completion to wait for: the thread fallback probes it
+bool UringBackend::push(AsyncRoute* route) {
+    unsigned int tail = *_sqTail;
+    unsigned int head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+
+    // never more in flight than the completion ring can hold
+    if (tail - head >= _sqEntries || _inflight >= _cqEntries)
+        return false;
+
+    unsigned int index = tail & _sqMask;
+    struct io_uring_sqe* sqe = &_sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<unsigned long>(route->path->c_str());
+    if (route->opening)
+    {
+        // the kernel's own permission check, groups and ACLs included; O_NONBLOCK: a fifo doesn't wait
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->open_flags = O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC;
+    }
+    else
+    {
+        sqe->opcode = IORING_OP_STATX;
+        sqe->len = STATX_BASIC_STATS;
+        sqe->off = reinterpret_cast<unsigned long>(&route->stx);
+    }
+    sqe->user_data = reinterpret_cast<unsigned long>(route);
+    _sqArray[index] = index;
+    __atomic_store_n(_sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    // IORING_ENTER without GETEVENTS only submits: it does not wait for the stat
+    long submitted;
+    do
+        submitted = syscall(__NR_io_uring_enter, _ring, 1, 0, 0, NULL, 0);
+    while (submitted < 0 && errno == EINTR);
+    if (submitted == 1)
+    {
+        ++_inflight;
+        return true;
+    }
+
+    // EAGAIN / EBUSY: the kernel did not take the sqe, take it back
+    __atomic_store_n(_sqTail, tail, __ATOMIC_RELEASE);
+    if (_inflight)
+        return false;
+    if (!_fallback)
+        _fallback = threadBackend(1, _event);
+    _fallback->submit(route);
+    return true;
+}
+
+void UringBackend::submit(AsyncRoute* route) {
+    if (!_backlog.empty() || !push(route))
+        _backlog.push_back(route);
+}
+
+// DO: Take every completion out of the ring, turning statx answers into FileProbes
+    // a statx whose mode bits don't decide readability goes back out as an openat instead of into done
+void UringBackend::collect(std::vector<AsyncRoute*>* done) {
+    unsigned int head = *_cqHead;
+    unsigned int tail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+
+    while (head != tail)
+    {
+        struct io_uring_cqe* cqe = &_cqes[head & _cqMask];
+        AsyncRoute* route = reinterpret_cast<AsyncRoute*>(cqe->user_data);
+
+        int res = cqe->res;
+        --_inflight;
+        // hand the slot back now: the openat submitted below may complete before the loop ends
+        __atomic_store_n(_cqHead, ++head, __ATOMIC_RELEASE);
+
+        bool final = true;
+        if (route->opening)
+        {
+            if (res >= 0)
+                close(res);
+            route->probe.readable = (res >= 0);
+            // out of fds says nothing about the file: a thread asks access()
+            if ((res == -EMFILE || res == -ENFILE) && done)
+            {
+                if (!_fallback)
+                    _fallback = threadBackend(1, _event);
+                _fallback->submit(route);
+                continue;
+            }
+        }
+        else
+        {
+            route->probe = FileProbe();
+            if (res == 0)
+            {
+                int readable = readableByMode(route->stx.stx_uid, route->stx.stx_mode);
+                route->probe.exists = true;
+                route->probe.directory = S_ISDIR(route->stx.stx_mode);
+                route->probe.readable = (readable == 1);
+                route->probe.size = route->stx.stx_size;
+                route->probe.mtime = route->stx.stx_mtime.tv_sec;
+                final = (readable >= 0);
+            }
+        }
+        if (!done)
+            delete route;
+        else if (final)
+            done->push_back(route);
+        else
+        {
+            route->opening = true;
+            submit(route);
+        }
+    }
+}
+
+void UringBackend::reap(std::vector<AsyncRoute*>& done) {
+    collect(&done);
+    while (!_backlog.empty() && push(_backlog.front()))
+        _backlog.pop_front();
+    if (_fallback)
+        _fallback->reap(done);
+}
+
+// ---- thread pool backend: workers run probePath() and signal the eventfd ----
+
+class ThreadBackend : public ProbeBackend
+{
+public:
+    ThreadBackend(size_t threads, int event);
+    ~ThreadBackend();
+
+    void submit(AsyncRoute* route);
+    void reap(std::vector<AsyncRoute*>& done);
+
+private:
+    int _event;
+    pthread_mutex_t _lock;
+    pthread_cond_t _wake;
+    std::deque<AsyncRoute*> _jobs;
+    std::vector<AsyncRoute*> _done;
+    std::vector<pthread_t> _threads;
+    bool _stop;
+
+    static void* worker(void* arg);
+};
+
+ThreadBackend::ThreadBackend(size_t threads, int event)
+    : _event(event), _stop(false)
+{
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_wake, NULL);
+    for (size_t i = 0; i < (threads ? threads : 1); ++i)
+    {
+        pthread_t t;
+        if (pthread_create(&t, NULL, &ThreadBackend::worker, this) == 0)
+            _threads.push_back(t);
+    }
+}
+
+ThreadBackend::~ThreadBackend()
+{
+    pthread_mutex_lock(&_lock);
+    _stop = true;
+    pthread_cond_broadcast(&_wake);
+    pthread_mutex_unlock(&_lock);
+    for (size_t i = 0; i < _threads.size(); ++i)
+        pthread_join(_threads[i], NULL);
+
+    for (size_t i = 0; i < _jobs.size(); ++i)
+        delete _jobs[i];
+    for (size_t i = 0; i < _done.size(); ++i)
+        delete _done[i];
+    pthread_cond_destroy(&_wake);
+    pthread_mutex_destroy(&_lock);
+}
+
+void* ThreadBackend::worker(void* arg) {
+    ThreadBackend& b = *static_cast<ThreadBackend*>(arg);
+
+    pthread_mutex_lock(&b._lock);
+    while (true)
+    {
+        while (b._jobs.empty() && !b._stop)
+            pthread_cond_wait(&b._wake, &b._lock);
+        if (b._stop)
+            break;
+        AsyncRoute* route = b._jobs.front();
+        b._jobs.pop_front();
+
+        // the slow part runs unlocked
+        pthread_mutex_unlock(&b._lock);
+        route->probe = probePath(*route->path);
+        pthread_mutex_lock(&b._lock);
+
+        b._done.push_back(route);
+        signal(b._event);
+    }
+    pthread_mutex_unlock(&b._lock);
+    return NULL;
+}
+
+void ThreadBackend::submit(AsyncRoute* route) {
+    pthread_mutex_lock(&_lock);
+    _jobs.push_back(route);
+    pthread_cond_signal(&_wake);
+    pthread_mutex_unlock(&_lock);
+}
+
+void ThreadBackend::reap(std::vector<AsyncRoute*>& done) {
+    pthread_mutex_lock(&_lock);
+    done.insert(done.end(), _done.begin(), _done.end());
+    _done.clear();
+    pthread_mutex_unlock(&_lock);
+}
+
+static ProbeBackend* threadBackend(size_t threads, int event) {
+    return new ThreadBackend(threads, event);
+}
+
+// ---- AsyncRouter ----
+
+AsyncRouter::AsyncRouter(const Config& config, size_t threads, unsigned int entries)
+    : _config(config), _backend(NULL), _uring(false), _event(-1), _pending(0)
+{
+    _event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_event < 0)
+        throw std::runtime_error("Cannot create the routing eventfd");
+
+    _backend = UringBackend::create(entries, _event);
+    _uring = (_backend != NULL);
+    if (!_backend)
+        _backend = new ThreadBackend(threads, _event);
+}
+
+AsyncRouter::~AsyncRouter()
+{
+    delete _backend;
+    for (size_t i = 0; i < _ready.size(); ++i)
+        delete _ready[i];
+    close(_event);
+}
+
+int AsyncRouter::fd() const
+{
+    return _event;
+}
+
+// DO: Start routing a request: matching now, filesystem probes in the background
+    // callback runs from a later poll(), never from inside route()
+void AsyncRouter::route(const std::string& host, int port, const std::string& uri,
+                        HttpMethod method, Callback callback, void* context)
+{
+    AsyncRoute* route = new AsyncRoute();
+    route->callback = callback;
+    route->context = context;
+    route->path = NULL;
+    route->step = routeMatch(_config, host, port, uri, method, route->result, route->plan);
+    ++_pending;
+    advance(route);
+}
+
+// Sends a route to its next probe, or to the ready list once it is final
+void AsyncRouter::advance(AsyncRoute* route)
+{
+    if (route->step == STEP_DONE)
+    {
+        _ready.push_back(route);
+        signal(_event);
+        return;
+    }
+    route->path = (route->step == STEP_PROBE_FILE) ? &route->result.file_path : &route->plan.index_path;
+    route->opening = false;
+    _backend->submit(route);
+}
+
+// DO: Handle what finished since the last call: run the next routing step, and the callbacks of the final ones
+// RETURN: the number of callbacks run
+size_t AsyncRouter::poll()
+{
+    uint64_t count;
+    ssize_t n = read(_event, &count, sizeof(count));
+    (void)n; // EAGAIN: nothing signaled, there may still be completions to reap
+
+    std::vector<AsyncRoute*> done;
+    _backend->reap(done);
+    for (size_t i = 0; i < done.size(); ++i)
+    {
+        AsyncRoute* route = done[i];
+        if (route->step == STEP_PROBE_FILE)
+            route->step = routeFile(_config, route->plan, route->result, route->probe);
+        else
+            route->step = routeIndex(_config, route->plan, route->result, route->probe);
+        advance(route);
+    }
+
+    // callbacks may start new routes: they land in the next poll()
+    std::vector<AsyncRoute*> ready;
+    ready.swap(_ready);
+    for (size_t i = 0; i < ready.size(); ++i)
+    {
+        STATS_RESULT(_config, ready[i]->plan, ready[i]->result);
+        ready[i]->callback(ready[i]->result, ready[i]->context);
+        delete ready[i];
+        --_pending;
+    }
+    return ready.size();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Router.hpp"
+
+struct AsyncRoute;
+class ProbeBackend;
+
+// AsyncRouter: routing for an event loop that must never wait on disk metadata
+    // server and location matching run inline in route(), the stat of the target and of the index
+    // are submitted to io_uring (IORING_OP_STATX, then IORING_OP_OPENAT when the mode bits can't tell
+    // readability), or to a small thread pool when io_uring is missing
+    // fd() becomes readable when results are ready: poll() then runs the callbacks, on the caller's thread
+    // the Config must outlive the router (and stay the same snapshot while routes are pending)
+class AsyncRouter
+{
+public:
+    typedef void (*Callback)(const RoutingResult& result, void* context);
+
+    AsyncRouter(const Config& config, size_t threads = 2, unsigned int entries = 256);
+    ~AsyncRouter();
+
+    void route(const std::string& host, int port, const std::string& uri,
+                        HttpMethod method, Callback callback, void* context);
+    int fd() const;
+    size_t poll();
+    size_t pending() const { return _pending; }
+    bool usingUring() const { return _uring; }
+
+private:
+    const Config& _config;
+    ProbeBackend* _backend;
+    bool _uring;
+    int _event;                       // eventfd: what fd() returns
+    std::vector<AsyncRoute*> _ready;  // finished inline, delivered by the next poll()
+    size_t _pending;
+
+    void advance(AsyncRoute* route);
+
+    AsyncRouter(const AsyncRouter&);
+    AsyncRouter& operator=(const AsyncRouter&);
+};
@@ -0,0 +1,173 @@
+#include "Autoindex.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <ctime>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// One line of the listing
+struct DirEntry
+{
+    std::string name;
+    bool directory;
+
+    bool operator<(const DirEntry& other) const { return name < other.name; }
+};
+
+// Text safe to put in HTML
+static void appendHtml(std::string& out, const std::string& s) {
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        switch (s[i])
+        {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            case '\'': out += "&#39;"; break;
+            default: out += s[i];
+        }
+    }
+}
+
+// Text safe to put in a URL path (then in an HTML attribute)
+static void appendUrl(std::string& out, const std::string& s) {
+    static const char hex[] = "0123456789ABCDEF";
+
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        unsigned char c = s[i];
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
+            out += c;
+        else
+        {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 15];
+        }
+    }
+}
+
+// DO: Read a directory, sorted by name
+    // the type comes from readdir (d_type): no stat per entry unless the filesystem does not say
+static std::vector<DirEntry> readDirectory(const std::string& directory) {
+    DIR* dir = opendir(directory.c_str());
+    if (!dir)
+        throw std::runtime_error("Cannot list directory: " + directory);
+
+    std::vector<DirEntry> entries;
+    struct dirent* d;
+    while ((d = readdir(dir)) != NULL)
+    {
+        DirEntry entry;
+        entry.name = d->d_name;
+        if (entry.name == "." || entry.name == "..")
+            continue;
+        if (d->d_type == DT_UNKNOWN || d->d_type == DT_LNK)
+        {
+            struct stat s;
+            entry.directory = (stat((directory + "/" + entry.name).c_str(), &s) == 0 && S_ISDIR(s.st_mode));
+        }
+        else
+            entry.directory = (d->d_type == DT_DIR);
+        entries.push_back(entry);
+    }
+    closedir(dir);
+    std::sort(entries.begin(), entries.end());
+    return entries;
+}
+
+// DO: The HTML page listing a directory, uncached
+// RETURN: the page, links are absolute (uri + name) so they work with or without a trailing '/' in uri
+std::string renderAutoindex(const std::string& directory, const std::string& uri) {
+    std::vector<DirEntry> entries = readDirectory(directory);
+    std::string base = uri;
+    if (base.empty() || base[base.size() - 1] != '/')
+        base += '/';
+
+    std::string html;
+    html.reserve(256 + entries.size() * (2 * 32 + 24));
+    html += "<html>\n<head><title>Index of ";
+    appendHtml(html, base);
+    html += "</title></head>\n<body>\n<h1>Index of ";
+    appendHtml(html, base);
+    html += "</h1><hr><pre>\n<a href=\"";
+    appendHtml(html, base);
+    html += "../\">../</a>\n";
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        const DirEntry& e = entries[i];
+        html += "<a href=\"";
+        appendHtml(html, base);
+        appendUrl(html, e.name);
+        if (e.directory)
+            html += '/';
+        html += "\">";
+        appendHtml(html, e.name);
+        if (e.directory)
+            html += '/';
+        html += "</a>\n";
+    }
+    html += "</pre><hr></body>\n</html>\n";
+    return html;
+}
+
+AutoindexCache::AutoindexCache(size_t capacity, long ttl_ms)
+    : _entries(capacity), _ttl(ttl_ms) {}
+
+// DO: The listing of directory for uri, from the cache while the directory did not change
+// RETURN: the HTML page; throws if the directory can't be read
+const std::string& AutoindexCache::listing(const std::string& directory, const std::string& uri) {
+    // the page shows the uri: one entry per (directory, uri)
+    std::string key = directory;
+    key += '\0';
+    key += uri;
+
+    long now = monotonicMs();
+    Entry* cached = _entries.find(key);
+    if (cached && !cached->racy && now - cached->checked < _ttl)
+    {
+        ++_stats.hits;
+        return cached->html;
+    }
+
+    struct stat s;
+    if (stat(directory.c_str(), &s) != 0)
+    {
+        _entries.erase(key);
+        throw std::runtime_error("Cannot list directory: " + directory);
+    }
+    if (cached && !cached->racy && cached->device == s.st_dev && cached->inode == s.st_ino
+        && cached->mtime.tv_sec == s.st_mtim.tv_sec && cached->mtime.tv_nsec == s.st_mtim.tv_nsec)
+    {
+        ++_stats.hits;
+        cached->checked = now;
+        return cached->html;
+    }
+    ++_stats.misses;
+
+    // mtimes are only as fine as the filesystem clock tick: an entry added in the same tick,
+    // after readdir, would not move it. A listing of a directory changed in the last second
+    // is served but rendered again next time, like git does with its racy index entries
+    std::string html = renderAutoindex(directory, uri);
+    Entry entry;
+    entry.device = s.st_dev;
+    entry.inode = s.st_ino;
+    entry.mtime = s.st_mtim;
+    entry.racy = (std::time(NULL) - s.st_mtim.tv_sec <= 1);
+    entry.checked = now;
+
+    if (cached)
+        *cached = entry;
+    else if (_entries.insert(key, entry))
+        ++_stats.evictions;
+    // moved in, not copied: listings of big directories are big
+    cached = _entries.find(key);
+    cached->html.swap(html);
+    return cached->html;
+}
+
+void AutoindexCache::clear() {
+    _entries.clear();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <ctime>
+#include <sys/types.h>
+#include "RouteCache.hpp"
+
+// AutoindexCache: the HTML listing of a directory (use_autoindex), rendered once and kept until it changes
+    // adding, removing or renaming an entry changes the directory's mtime: a lookup compares it
+    // (one stat, at most once per ttl_ms) and renders again only when it moved
+    // the listing is one contiguous string: send it in as many slices as the socket takes
+    // the reference returned stays valid until the next call; not thread safe: one per worker thread
+class AutoindexCache
+{
+public:
+    AutoindexCache(size_t capacity = 256, long ttl_ms = 1000);
+
+    const std::string& listing(const std::string& directory, const std::string& uri);
+
+    void clear();
+    const CacheStats& stats() const { return _stats; }
+
+private:
+    struct Entry
+    {
+        std::string html;
+        dev_t device;
+        ino_t inode;
+        struct timespec mtime;
+        bool racy;    // rendered in the same second the directory changed: not trusted
+        long checked; // ms, monotonic clock
+    };
+
+    LruMap<Entry> _entries;
+    long _ttl;
+    CacheStats _stats;
+};
+
+std::string renderAutoindex(const std::string& directory, const std::string& uri);
@@ -0,0 +1,633 @@
+#include "Cgi.hpp"
+#include "RouteCache.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+// FastCGI record types, as in the FastCGI 1.0 specification
+enum
+{
+    FCGI_BEGIN_REQUEST = 1,
+    FCGI_END_REQUEST = 3,
+    FCGI_PARAMS = 4,
+    FCGI_STDIN = 5,
+    FCGI_STDOUT = 6,
+    FCGI_STDERR = 7
+};
+
+static const unsigned char FCGI_VERSION = 1;
+static const unsigned char FCGI_RESPONDER = 1;
+static const unsigned char FCGI_REQUEST_COMPLETE = 0;
+static const unsigned char FCGI_OVERLOADED = 2;
+static const size_t FCGI_HEADER = 8;
+static const size_t FCGI_MAX_CONTENT = 65535;
+static const long RETIRE_GRACE_MS = 100; // after SIGTERM, before a retired worker gets SIGKILL
+
+struct CgiWorker
+{
+    pid_t pid;              // -1: not running, started again by the next request it gets
+    std::string socket;
+    unsigned long served;   // requests since it was started
+    bool busy;
+
+    CgiWorker() : pid(-1), served(0), busy(false) {}
+};
+
+struct CgiExtension
+{
+    std::vector<std::string> argv;
+    std::vector<CgiWorker> workers;
+    size_t waiting;         // requests blocked in run() for a free worker
+    pthread_cond_t freed;   // a worker is not busy any more; on the monotonic clock
+
+    CgiExtension() : waiting(0) {}
+};
+
+// ---- FastCGI framing ----
+
+static void record(std::string& out, unsigned char type, const char* data, size_t length) {
+    unsigned char padding = (8 - length % 8) % 8;
+    char header[FCGI_HEADER] = {
+        (char)FCGI_VERSION, (char)type, 0, 1, // request id 1: one request per connection
+        (char)(length >> 8), (char)(length & 0xff), (char)padding, 0
+    };
+
+    out.append(header, FCGI_HEADER);
+    out.append(data, length);
+    out.append(padding, '\0');
+}
+
+// DO: A whole stream as records, closed by the empty one
+static void stream(std::string& out, unsigned char type, const std::string& data) {
+    for (size_t at = 0; at < data.size(); at += FCGI_MAX_CONTENT)
+        record(out, type, data.data() + at, std::min(FCGI_MAX_CONTENT, data.size() - at));
+    record(out, type, "", 0);
+}
+
+static void nameValueLength(std::string& out, size_t length) {
+    if (length < 128)
+    {
+        out += (char)length;
+        return;
+    }
+    out += (char)((length >> 24) | 0x80);
+    out += (char)(length >> 16);
+    out += (char)(length >> 8);
+    out += (char)length;
+}
+
+// DO: The CGI/1.1 meta-variables of a request
+static void cgiParams(const CgiRequest& request, std::vector<std::pair<std::string, std::string> >& params) {
+    char length[32];
+    std::sprintf(length, "%lu", (unsigned long)request.body.size());
+
+    params.push_back(std::make_pair("GATEWAY_INTERFACE", "CGI/1.1"));
+    params.push_back(std::make_pair("SERVER_PROTOCOL", "HTTP/1.1"));
+    params.push_back(std::make_pair("SERVER_SOFTWARE", "webserv"));
+    params.push_back(std::make_pair("REQUEST_METHOD", request.method));
+    params.push_back(std::make_pair("SCRIPT_FILENAME", request.script));
+    params.push_back(std::make_pair("SCRIPT_NAME", request.uri));
+    params.push_back(std::make_pair("REQUEST_URI", request.query.empty() ? request.uri : request.uri + "?" + request.query));
+    params.push_back(std::make_pair("QUERY_STRING", request.query));
+    params.push_back(std::make_pair("CONTENT_LENGTH", std::string(length)));
+    params.push_back(std::make_pair("CONTENT_TYPE", request.content_type));
+    params.push_back(std::make_pair("REDIRECT_STATUS", "200")); // php-cgi refuses to run without it
+    params.insert(params.end(), request.params.begin(), request.params.end());
+}
+
+// DO: The records of one request: begin (the worker closes the connection when done), params, stdin
+static void fastcgiRequest(const CgiRequest& request, std::string& out) {
+    const char begin[8] = { 0, (char)FCGI_RESPONDER, 0, 0, 0, 0, 0, 0 };
+    record(out, FCGI_BEGIN_REQUEST, begin, sizeof(begin));
+
+    std::vector<std::pair<std::string, std::string> > params;
+    cgiParams(request, params);
+    std::string encoded;
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        nameValueLength(encoded, params[i].first.size());
+        nameValueLength(encoded, params[i].second.size());
+        encoded += params[i].first;
+        encoded += params[i].second;
+    }
+    stream(out, FCGI_PARAMS, encoded);
+    stream(out, FCGI_STDIN, request.body);
+}
+
+// DO: Collect the stdout / stderr records of a reply
+// RETURN: CGI_DONE once the request ended complete, CGI_FAILED for a truncated or broken reply
+static CgiStatus fastcgiReply(const std::string& in, CgiResult& result) {
+    size_t at = 0;
+
+    while (in.size() - at >= FCGI_HEADER)
+    {
+        const unsigned char* header = (const unsigned char*)in.data() + at;
+        size_t length = (header[4] << 8) | header[5];
+        if (header[0] != FCGI_VERSION || in.size() - at < FCGI_HEADER + length + header[6])
+            return CGI_FAILED;
+        const char* content = in.data() + at + FCGI_HEADER;
+
+        if (header[1] == FCGI_STDOUT)
+            result.output.append(content, length);
+        else if (header[1] == FCGI_STDERR)
+            result.errors.append(content, length);
+        else if (header[1] == FCGI_END_REQUEST && length >= 8)
+        {
+            unsigned char protocol = content[4];
+            if (protocol == FCGI_OVERLOADED)
+                return CGI_BUSY;
+            return protocol == FCGI_REQUEST_COMPLETE ? CGI_DONE : CGI_FAILED;
+        }
+        at += FCGI_HEADER + length + header[6];
+    }
+    return CGI_FAILED;
+}
+
+// ---- transport ----
+
+// DO: Send out on a connected socket while reading everything back, until the peer closes it
+    // both at once: a script may answer before it read all of its body
+    // shut_write: close our side once out is sent (plain CGI: the end of stdin)
+// RETURN: CGI_DONE, CGI_TIMEOUT past deadline, or CGI_FAILED
+static CgiStatus exchange(int fd, const std::string& out, bool shut_write, long deadline, std::string& in) {
+    size_t sent = 0;
+    char buffer[16384];
+
+    if (out.empty() && shut_write)
+        shutdown(fd, SHUT_WR);
+    while (true)
+    {
+        long left = deadline - monotonicMs();
+        if (left <= 0)
+            return CGI_TIMEOUT;
+        struct pollfd p;
+        p.fd = fd;
+        p.events = POLLIN | (sent < out.size() ? POLLOUT : 0);
+        int ready = poll(&p, 1, left);
+        if (ready < 0 && errno != EINTR)
+            return CGI_FAILED;
+        if (ready <= 0)
+            continue;
+
+        if ((p.revents & POLLOUT) && sent < out.size())
+        {
+            ssize_t n = send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n < 0 && errno != EAGAIN && errno != EINTR)
+                n = out.size() - sent; // the script stopped reading: keep its answer
+            if (n > 0 && (sent += n) == out.size() && shut_write)
+                shutdown(fd, SHUT_WR);
+        }
+        if (p.revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n == 0 || (n < 0 && errno == ECONNRESET))
+                return CGI_DONE;
+            if (n < 0 && errno != EAGAIN && errno != EINTR)
+                return CGI_FAILED;
+            if (n > 0)
+                in.append(buffer, n);
+        }
+    }
+}
+
+static void socketAddress(const std::string& path, struct sockaddr_un& addr) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+}
+
+// RETURN: a connection to the worker, -1 if it does not listen (any more)
+static int connectWorker(const CgiWorker& worker) {
+    if (worker.pid <= 0)
+        return -1;
+    struct sockaddr_un addr;
+    socketAddress(worker.socket, addr);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+// ---- workers ----
+
+static std::vector<char*> argvOf(const std::vector<std::string>& argv) {
+    std::vector<char*> args;
+    for (size_t i = 0; i < argv.size(); ++i)
+        args.push_back(const_cast<char*>(argv[i].c_str()));
+    args.push_back(NULL);
+    return args;
+}
+
+// DO: Start a worker on its own listening socket, given as its fd 0
+    // the socket listens before fork(): a request can connect before the interpreter is even up
+static void startWorker(CgiWorker& worker, const std::vector<std::string>& argv) {
+    struct sockaddr_un addr;
+    socketAddress(worker.socket, addr);
+    unlink(worker.socket.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 16) != 0)
+    {
+        if (listener >= 0)
+            close(listener);
+        throw std::runtime_error("Cannot listen on " + worker.socket);
+    }
+
+    std::vector<char*> args = argvOf(argv); // no allocation after fork()
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(listener);
+        throw std::runtime_error("Cannot start cgi worker " + argv[0]);
+    }
+    if (pid == 0)
+    {
+        // FastCGI: stdin is the listening socket, stdout is not used
+        dup2(listener, 0);
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0)
+            dup2(null, 1);
+        execvp(args[0], &args[0]);
+        _exit(127);
+    }
+    close(listener);
+    worker.pid = pid;
+    worker.served = 0;
+}
+
+// DO: Stop a worker: SIGTERM and a short grace, or SIGKILL straight away (force: it hangs)
+static void stopWorker(CgiWorker& worker, bool force) {
+    if (worker.pid <= 0)
+        return;
+    pid_t done = 0;
+    if (!force)
+    {
+        kill(worker.pid, SIGTERM);
+        for (int i = 0; i < 50 && (done = waitpid(worker.pid, NULL, WNOHANG)) == 0; ++i)
+            usleep(2000);
+    }
+    if (done == 0)
+    {
+        kill(worker.pid, SIGKILL);
+        waitpid(worker.pid, NULL, 0);
+    }
+    worker.pid = -1;
+}
+
+// DO: Take a worker out of service without waiting for it to exit: SIGTERM, or SIGKILL (force: it hangs)
+    // RETURN: its pid, for reapRetired(); -1 if it was down
+static pid_t retireWorker(CgiWorker& worker, bool force) {
+    pid_t pid = worker.pid;
+    if (pid <= 0)
+        return -1;
+    kill(pid, force ? SIGKILL : SIGTERM);
+    worker.pid = -1;
+    return pid;
+}
+
+// DO: Reap the retired workers that exited, SIGKILL those still there after their grace
+static void reapRetired(std::vector<std::pair<pid_t, long> >& retired, long now) {
+    for (size_t i = 0; i < retired.size(); )
+    {
+        if (waitpid(retired[i].first, NULL, WNOHANG) != 0)
+        {
+            retired[i] = retired.back();
+            retired.pop_back();
+            continue;
+        }
+        if (now >= retired[i].second)
+            kill(retired[i].first, SIGKILL);
+        ++i;
+    }
+}
+
+// DO: Start a worker that is down; if it can't start it stays down and the next request tries again
+static void reviveWorker(CgiWorker& worker, const std::vector<std::string>& argv) {
+    try
+    {
+        startWorker(worker, argv);
+    }
+    catch (const std::exception&)
+    {
+        worker.pid = -1;
+    }
+}
+
+static CgiWorker* idleWorker(CgiExtension& extension) {
+    for (size_t i = 0; i < extension.workers.size(); ++i)
+        if (!extension.workers[i].busy)
+            return &extension.workers[i];
+    return NULL;
+}
+
+// ---- CgiPool ----
+
+CgiPool::CgiPool(const CgiOptions& options)
+    : _options(options)
+{
+    char dir[] = "/tmp/webserv-cgi-XXXXXX";
+    if (!mkdtemp(dir))
+        throw std::runtime_error("Cannot create the cgi socket directory");
+    _dir = dir;
+    pthread_mutex_init(&_lock, NULL);
+}
+
+// run() must not be running any more
+CgiPool::~CgiPool()
+{
+    for (std::map<std::string, CgiExtension*>::iterator it = _extensions.begin(); it != _extensions.end(); ++it)
+    {
+        CgiExtension* extension = it->second;
+        for (size_t i = 0; i < extension->workers.size(); ++i)
+        {
+            stopWorker(extension->workers[i], false);
+            unlink(extension->workers[i].socket.c_str());
+        }
+        pthread_cond_destroy(&extension->freed);
+        delete extension;
+    }
+    // the retired ones had their SIGTERM already
+    for (size_t i = 0; i < _retired.size(); ++i)
+    {
+        kill(_retired[i].first, SIGKILL);
+        waitpid(_retired[i].first, NULL, 0);
+    }
+    rmdir(_dir.c_str());
+    pthread_mutex_destroy(&_lock);
+}
+
+// DO: Start the workers of an extension
+    // argv: a FastCGI program, found in PATH (e.g. php-cgi); it learns the script from SCRIPT_FILENAME
+void CgiPool::add(const std::string& extension, const std::vector<std::string>& argv) {
+    if (argv.empty())
+        throw std::runtime_error("No cgi interpreter for " + extension);
+    if (_extensions.count(extension))
+        throw std::runtime_error("Duplicate cgi pool for " + extension);
+
+    CgiExtension* pool = new CgiExtension();
+    pool->argv = argv;
+    pool->workers.resize(_options.workers ? _options.workers : 1);
+    for (size_t i = 0; i < pool->workers.size(); ++i)
+    {
+        char name[64];
+        std::sprintf(name, "/%lu-%lu", (unsigned long)_extensions.size(), (unsigned long)i);
+        pool->workers[i].socket = _dir + name;
+    }
+    if (pool->workers[0].socket.size() >= sizeof(((struct sockaddr_un*)NULL)->sun_path))
+    {
+        std::string path = pool->workers[0].socket;
+        delete pool;
+        throw std::runtime_error("cgi socket path too long: " + path);
+    }
+
+    try
+    {
+        for (size_t i = 0; i < pool->workers.size(); ++i)
+            startWorker(pool->workers[i], argv);
+    }
+    catch (const std::exception&)
+    {
+        for (size_t i = 0; i < pool->workers.size(); ++i)
+            stopWorker(pool->workers[i], true);
+        delete pool;
+        throw;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&pool->freed, &attr);
+    pthread_condattr_destroy(&attr);
+    _extensions[extension] = pool;
+}
+
+// DO: Run a request on a free worker of its extension, waiting for one if there is room in the queue
+    // a worker is retired after max_requests, and killed when it times out or fails: the request that
+    // retires it does not wait for the exit (reapRetired() does, later) and the next one starts a new worker
+    // the answer gets its full timeout from when the worker is ours: time spent queued never counts
+    // against a worker, which would turn a long queue into a cascade of killed healthy workers
+CgiResult CgiPool::run(const std::string& extension, const CgiRequest& request) {
+    CgiResult result;
+    long queued_until = monotonicMs() + _options.timeout_ms;
+
+    pthread_mutex_lock(&_lock);
+    std::map<std::string, CgiExtension*>::iterator it = _extensions.find(extension);
+    if (it == _extensions.end())
+    {
+        pthread_mutex_unlock(&_lock);
+        result.status = CGI_NO_INTERPRETER;
+        return result;
+    }
+    CgiExtension& pool = *it->second;
+    ++_stats.requests;
+    reapRetired(_retired, monotonicMs());
+
+    CgiWorker* worker = idleWorker(pool);
+    if (!worker && pool.waiting < _options.queue)
+    {
+        struct timespec until;
+        until.tv_sec = queued_until / 1000;
+        until.tv_nsec = queued_until % 1000 * 1000000L;
+        ++pool.waiting;
+        while (!(worker = idleWorker(pool)) && pthread_cond_timedwait(&pool.freed, &_lock, &until) != ETIMEDOUT)
+            ;
+        --pool.waiting;
+    }
+    if (!worker)
+    {
+        ++_stats.refused;
+        pthread_mutex_unlock(&_lock);
+        result.status = CGI_BUSY;
+        return result;
+    }
+    worker->busy = true;
+    pthread_mutex_unlock(&_lock);
+
+    // the worker is ours until busy is cleared: the rest runs unlocked
+    long deadline = monotonicMs() + _options.timeout_ms;
+    std::vector<pid_t> retired;
+    std::string out, in;
+    fastcgiRequest(request, out);
+    if (worker->pid <= 0)
+        reviveWorker(*worker, pool.argv);
+    int fd = connectWorker(*worker);
+    if (fd < 0 && worker->pid > 0)
+    {
+        // it died: once more with a new one
+        retired.push_back(retireWorker(*worker, true));
+        reviveWorker(*worker, pool.argv);
+        fd = connectWorker(*worker);
+    }
+    result.status = (fd < 0) ? CGI_FAILED : exchange(fd, out, false, deadline, in);
+    if (fd >= 0)
+        close(fd);
+    if (result.status == CGI_DONE)
+        result.status = fastcgiReply(in, result);
+
+    ++worker->served;
+    if ((result.status == CGI_TIMEOUT || result.status == CGI_FAILED
+         || (_options.max_requests && worker->served >= _options.max_requests)) && worker->pid > 0)
+        retired.push_back(retireWorker(*worker, result.status == CGI_TIMEOUT));
+
+    pthread_mutex_lock(&_lock);
+    long kill_at = monotonicMs() + RETIRE_GRACE_MS;
+    for (size_t i = 0; i < retired.size(); ++i)
+        _retired.push_back(std::make_pair(retired[i], kill_at));
+    _stats.restarts += retired.size();
+    if (result.status == CGI_TIMEOUT)
+        ++_stats.timeouts;
+    else if (result.status == CGI_BUSY)
+        ++_stats.refused;
+    worker->busy = false;
+    pthread_cond_signal(&pool.freed);
+    pthread_mutex_unlock(&_lock);
+    return result;
+}
+
+bool CgiPool::has(const std::string& extension) const {
+    pthread_mutex_lock(&_lock);
+    bool found = _extensions.count(extension) != 0;
+    pthread_mutex_unlock(&_lock);
+    return found;
+}
+
+CgiStats CgiPool::stats() const {
+    pthread_mutex_lock(&_lock);
+    CgiStats stats = _stats;
+    pthread_mutex_unlock(&_lock);
+    return stats;
+}
+
+// ---- plain CGI ----
+
+// RETURN: the program execvp() would run for `name`, searched in the server's own PATH; "" if none
+    // the child gets only the CGI meta-variables as its environment: execvp() there would not see our PATH
+static std::string findProgram(const std::string& name) {
+    if (name.find('/') != std::string::npos)
+        return name;
+    const char* path = std::getenv("PATH");
+    std::string dirs = (path && *path) ? path : "/usr/local/bin:/usr/bin:/bin";
+
+    size_t start = 0;
+    while (start <= dirs.size())
+    {
+        size_t end = dirs.find(':', start);
+        if (end == std::string::npos)
+            end = dirs.size();
+        std::string dir = dirs.substr(start, end - start);
+        std::string candidate = (dir.empty() ? std::string(".") : dir) + "/" + name;
+        struct stat s;
+        if (stat(candidate.c_str(), &s) == 0 && S_ISREG(s.st_mode) && access(candidate.c_str(), X_OK) == 0)
+            return candidate;
+        start = end + 1;
+    }
+    return "";
+}
+
+// DO: Run a script the classic way: fork(), exec of argv + the script, meta-variables in the environment,
+    // the body on stdin, the answer on stdout; for extensions without a pool (and to compare with one)
+CgiResult runCgi(const std::vector<std::string>& argv, const CgiRequest& request, long timeout_ms) {
+    CgiResult result;
+    if (argv.empty())
+    {
+        result.status = CGI_NO_INTERPRETER;
+        return result;
+    }
+    std::string program = findProgram(argv[0]);
+    if (program.empty())
+    {
+        result.status = CGI_NO_INTERPRETER;
+        return result;
+    }
+    long deadline = monotonicMs() + timeout_ms;
+
+    std::vector<std::pair<std::string, std::string> > params;
+    cgiParams(request, params);
+    std::vector<std::string> variables;
+    for (size_t i = 0; i < params.size(); ++i)
+        variables.push_back(params[i].first + "=" + params[i].second);
+    std::vector<std::string> command(argv);
+    command.push_back(request.script);
+    std::vector<char*> args = argvOf(command);
+    std::vector<char*> env = argvOf(variables);
+
+    // a socket pair rather than pipes: MSG_NOSIGNAL, and one fd for both ways
+    int ends[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, ends) != 0)
+        return result;
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(ends[0]);
+        close(ends[1]);
+        return result;
+    }
+    if (pid == 0)
+    {
+        dup2(ends[1], 0);
+        dup2(ends[1], 1);
+        execve(program.c_str(), &args[0], &env[0]);
+        _exit(127);
+    }
+    close(ends[1]);
+
+    result.status = exchange(ends[0], request.body, true, deadline, result.output);
+    close(ends[0]);
+    // timed out or broke the exchange: don't wait for it to exit on its own
+    if (result.status != CGI_DONE)
+        kill(pid, SIGKILL);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (result.status == CGI_DONE && WIFEXITED(status) && WEXITSTATUS(status) == 127 && result.output.empty())
+        result.status = CGI_FAILED; // exec failed
+    return result;
+}
+
+// RETURN: true if a routed request runs a script: a file of its location's cgi_extension
+bool isCgiRoute(const RoutingResult& route) {
+    if (route.status != ROUTE_OK || !route.location || route.is_directory)
+        return false;
+    const std::string& extension = route.location->cgi_extension;
+    const std::string& path = route.file_path;
+    return !extension.empty() && path.size() > extension.size()
+           && path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+// RETURN: every cgi_extension of the config, once: the pools to add()
+std::vector<std::string> cgiExtensions(const Config& config) {
+    std::vector<std::string> extensions;
+
+    for (size_t i = 0; i < config.servers.size(); ++i)
+        for (size_t j = 0; j < config.servers[i].locations.size(); ++j)
+        {
+            const std::string& extension = config.servers[i].locations[j].cgi_extension;
+            if (!extension.empty() && std::find(extensions.begin(), extensions.end(), extension) == extensions.end())
+                extensions.push_back(extension);
+        }
+    return extensions;
+}
+
+int cgiStatusCode(CgiStatus status) {
+    switch (status)
+    {
+        case CGI_DONE:              return 200;
+        case CGI_NO_INTERPRETER:    return 500;
+        case CGI_BUSY:              return 503;
+        case CGI_TIMEOUT:           return 504;
+        case CGI_FAILED:            return 502;
+    }
+    return 500;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <pthread.h>
+#include <sys/types.h>
+#include "Router.hpp"
+
+// Outcome of running a CGI request
+enum CgiStatus
+{
+    CGI_DONE,               // output holds what the script wrote
+    CGI_NO_INTERPRETER,     // no pool for that extension
+    CGI_BUSY,               // every worker busy and the queue full (or no worker freed in time)
+    CGI_TIMEOUT,            // the script did not answer in time: its worker was killed
+    CGI_FAILED              // the worker could not be reached, or died, or broke the protocol
+};
+
+// What a script is run with: turned into CGI meta-variables (FastCGI params, or the environment)
+struct CgiRequest
+{
+    std::string method;
+    std::string script;         // SCRIPT_FILENAME: the routed file_path
+    std::string uri;            // SCRIPT_NAME: the uri without its query
+    std::string query;          // QUERY_STRING
+    std::string content_type;
+    std::string body;
+    std::vector<std::pair<std::string, std::string> > params; // any other: HTTP_*, SERVER_NAME, ...
+};
+
+struct CgiResult
+{
+    CgiStatus status;
+    std::string output;     // the script's stdout: CGI headers, blank line, body
+    std::string errors;     // its FCGI_STDERR
+
+    CgiResult() : status(CGI_FAILED) {}
+};
+
+struct CgiOptions
+{
+    size_t workers;             // per extension
+    unsigned long max_requests; // a worker is restarted after that many requests, 0: never
+    long timeout_ms;            // waiting for a worker (then CGI_BUSY), and again for its answer (then CGI_TIMEOUT)
+    size_t queue;               // requests waiting for a worker before the next ones get CGI_BUSY
+
+    CgiOptions() : workers(4), max_requests(1000), timeout_ms(30000), queue(64) {}
+};
+
+struct CgiStats
+{
+    unsigned long requests;
+    unsigned long refused;      // CGI_BUSY: no worker freed in time, or one answered FCGI_OVERLOADED
+    unsigned long timeouts;
+    unsigned long restarts;     // workers restarted: max_requests, timeout or death
+
+    CgiStats() : requests(0), refused(0), timeouts(0), restarts(0) {}
+};
+
+struct CgiWorker;
+struct CgiExtension;
+
+// CgiPool: persistent FastCGI workers per cgi_extension, so a request costs a connect() instead of a fork() + exec()
+    // every worker is started with its own listening unix socket as fd 0 (the FastCGI convention, e.g. php-cgi)
+    // and gets one request at a time over a new connection: FCGI_BEGIN_REQUEST, FCGI_PARAMS, FCGI_STDIN,
+    // then FCGI_STDOUT / FCGI_STDERR until the worker closes the connection
+    // backpressure: a request waits for a free worker while at most `queue` others do, until its timeout
+    // add() every extension first; then run() is thread safe and blocks its caller: call it from worker threads
+class CgiPool
+{
+public:
+    CgiPool(const CgiOptions& options = CgiOptions());
+    ~CgiPool();
+
+    void add(const std::string& extension, const std::vector<std::string>& argv);
+    CgiResult run(const std::string& extension, const CgiRequest& request);
+    bool has(const std::string& extension) const;
+    CgiStats stats() const;
+
+private:
+    CgiOptions _options;
+    std::string _dir;           // holds the workers' sockets
+    std::map<std::string, CgiExtension*> _extensions;
+    mutable pthread_mutex_t _lock;
+    CgiStats _stats;
+    std::vector<std::pair<pid_t, long> > _retired; // workers signaled but not reaped yet, and when to SIGKILL them
+
+    CgiPool(const CgiPool&);
+    CgiPool& operator=(const CgiPool&);
+};
+
+CgiResult runCgi(const std::vector<std::string>& argv, const CgiRequest& request, long timeout_ms);
+bool isCgiRoute(const RoutingResult& route);
+std::vector<std::string> cgiExtensions(const Config& config);
+int cgiStatusCode(CgiStatus status);
@@ -1 +1,266 @@
 #include "Config.hpp"
+#include <cstring>
+
+// DO: Classify a request method, done once per request
+// RETURN: its HttpMethod bit, METHOD_UNKNOWN if we don't know it
+HttpMethod parseMethod(const char* name, size_t length) {
+    switch (length)
+    {
+        case 3:
+            if (std::memcmp(name, "GET", 3) == 0) return METHOD_GET;
+            if (std::memcmp(name, "PUT", 3) == 0) return METHOD_PUT;
+            break;
+        case 4:
+            if (std::memcmp(name, "POST", 4) == 0) return METHOD_POST;
+            if (std::memcmp(name, "HEAD", 4) == 0) return METHOD_HEAD;
+            break;
+        case 6:
+            if (std::memcmp(name, "DELETE", 6) == 0) return METHOD_DELETE;
+            break;
+        case 7:
+            if (std::memcmp(name, "OPTIONS", 7) == 0) return METHOD_OPTIONS;
+            break;
+    }
+    return METHOD_UNKNOWN;
+}
+
+HttpMethod parseMethod(const std::string& name) {
+    return parseMethod(name.data(), name.size());
+}
+
+const char* methodName(HttpMethod method) {
+    switch (method)
+    {
+        case METHOD_GET: return "GET";
+        case METHOD_POST: return "POST";
+        case METHOD_DELETE: return "DELETE";
+        case METHOD_HEAD: return "HEAD";
+        case METHOD_PUT: return "PUT";
+        case METHOD_OPTIONS: return "OPTIONS";
+        default: return "";
+    }
+}
+
+// DO: FNV-1a hash of a server name
+// RETURN: the 32 bit hash
+unsigned int hashName(const std::string& name) {
+    unsigned int h = 2166136261u;
+
+    for (size_t i = 0; i < name.size(); ++i)
+    {
+        h ^= static_cast<unsigned char>(name[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Double the slot array and re-insert every used slot
+static void growNames(PortRoute& route) {
+    std::vector<NameSlot> old;
+    old.swap(route.names);
+
+    size_t size = old.empty() ? 8 : old.size() * 2;
+    route.names.resize(size);
+
+    for (size_t i = 0; i < old.size(); ++i)
+    {
+        if (old[i].server == std::string::npos)
+            continue;
+        size_t pos = old[i].hash & (size - 1);
+        while (route.names[pos].server != std::string::npos)
+            pos = (pos + 1) & (size - 1);
+        route.names[pos] = old[i];
+    }
+}
+
+// Insert a name unless it is already there: the first server keeps the name
+static void insertName(PortRoute& route, const std::string& name, size_t server) {
+    // keep the load factor under 1/2 so probes stay short
+    if ((route.used + 1) * 2 > route.names.size())
+        growNames(route);
+
+    unsigned int h = hashName(name);
+    size_t mask = route.names.size() - 1;
+    size_t pos = h & mask;
+
+    while (route.names[pos].server != std::string::npos)
+    {
+        if (route.names[pos].hash == h && route.names[pos].name == name)
+            return;
+        pos = (pos + 1) & mask;
+    }
+    route.names[pos].hash = h;
+    route.names[pos].name = name;
+    route.names[pos].server = server;
+    ++route.used;
+}
+
+// DO: Build the routing table from the parsed servers
+    // the servers are walked in file order so the first server on a port becomes its default,
+    // and the first server declaring a name on a port keeps that name (same rules as the old linear scan)
+void compileRoutes(Config& config) {
+    config.routes.ports.clear();
+
+    for (size_t i = 0; i < config.servers.size(); ++i)
+    {
+        compileLocations(config.servers[i]);
+        const ServerConfig& server = config.servers[i];
+
+        for (size_t j = 0; j < server.listens.size(); ++j)
+        {
+            int port = server.listens[j].listen_port;
+            std::map<int, PortRoute>::iterator it = config.routes.ports.find(port);
+
+            if (it == config.routes.ports.end())
+            {
+                it = config.routes.ports.insert(std::make_pair(port, PortRoute())).first;
+                it->second.default_server = i;
+            }
+            for (size_t k = 0; k < server.server_name.size(); ++k)
+                insertName(it->second, server.server_name[k], i);
+        }
+    }
+    freezeConfig(config);
+}
+
+// DO: Look up the routes of a port
+// RETURN: the PortRoute, or NULL if nothing listens on that port
+const PortRoute* findPort(const RouteTable& table, int port) {
+    std::map<int, PortRoute>::const_iterator it = table.ports.find(port);
+
+    if (it == table.ports.end())
+        return NULL;
+    return &it->second;
+}
+
+// DO: Probe the host index of a port
+// RETURN: the index of the server owning that name, or npos
+size_t findServerByName(const PortRoute& route, const std::string& host) {
+    if (route.names.empty())
+        return std::string::npos;
+
+    unsigned int h = hashName(host);
+    size_t mask = route.names.size() - 1;
+    size_t pos = h & mask;
+
+    while (route.names[pos].server != std::string::npos)
+    {
+        if (route.names[pos].hash == h && route.names[pos].name == host)
+            return route.names[pos].server;
+        pos = (pos + 1) & mask;
+    }
+    return std::string::npos;
+}
+
+// Binary search of a segment (uri[pos, pos + len)) among the sorted edges of a node
+// RETURN: the position of the edge, or where it should be inserted
+static size_t lowerEdge(const LocationNode& node, const std::string& uri, size_t pos, size_t len) {
+    size_t lo = 0;
+    size_t hi = node.edges.size();
+
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (uri.compare(pos, len, node.edges[mid].segment) > 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// DO: Build the path-segment trie of a server's locations
+    // "/docs/img" is stored as root -> "" -> "docs" -> "img" (every segment follows a '/'),
+    // so reaching a node means the uri continues with '/' or ends: the /images vs /imageshack rule for free.
+    // "/" is kept apart because it matches everything, and an empty path never matched anything.
+    // on duplicate paths the first location keeps the node, like the old scan did.
+void compileLocations(ServerConfig& server) {
+    // children are collected in maps first: inserting into the sorted edge vectors
+    // one by one is quadratic when a node has thousands of children (one location per tenant)
+    std::vector<std::map<std::string, size_t> > children(1);
+    std::vector<size_t> locations(1, std::string::npos);
+
+    server.root_location = std::string::npos;
+    for (size_t i = 0; i < server.locations.size(); ++i)
+    {
+        const std::string& path = server.locations[i].path;
+
+        if (path.empty())
+            continue;
+        if (path == "/")
+        {
+            if (server.root_location == std::string::npos)
+                server.root_location = i;
+            continue;
+        }
+
+        size_t node = 0;
+        size_t pos = 0;
+        while (true)
+        {
+            size_t slash = path.find('/', pos);
+            size_t len = (slash == std::string::npos ? path.size() : slash) - pos;
+            std::pair<std::map<std::string, size_t>::iterator, bool> edge =
+                children[node].insert(std::make_pair(path.substr(pos, len), children.size()));
+
+            node = edge.first->second;
+            if (edge.second)
+            {
+                children.push_back(std::map<std::string, size_t>());
+                locations.push_back(std::string::npos);
+            }
+            if (slash == std::string::npos)
+                break;
+            pos = slash + 1;
+        }
+        if (locations[node] == std::string::npos)
+            locations[node] = i;
+    }
+
+    // flatten: a map iterates in the same order lowerEdge searches
+    server.location_trie.assign(children.size(), LocationNode());
+    for (size_t n = 0; n < children.size(); ++n)
+    {
+        LocationNode& node = server.location_trie[n];
+        node.location = locations[n];
+        node.edges.reserve(children[n].size());
+        for (std::map<std::string, size_t>::const_iterator it = children[n].begin(); it != children[n].end(); ++it)
+        {
+            LocationEdge edge;
+            edge.segment = it->first;
+            edge.child = it->second;
+            node.edges.push_back(edge);
+        }
+    }
+}
+
+// DO: Walk the uri segment by segment down the location trie
+// RETURN: the index of the longest matching location, or npos
+size_t findLocation(const ServerConfig& server, const std::string& uri) {
+    size_t match = std::string::npos;
+
+    if (!uri.empty() && uri[0] == '/')
+        match = server.root_location;
+    if (server.location_trie.empty())
+        return match;
+
+    size_t node = 0;
+    size_t pos = 0;
+    while (true)
+    {
+        const LocationNode& current = server.location_trie[node];
+        size_t slash = uri.find('/', pos);
+        size_t len = (slash == std::string::npos ? uri.size() : slash) - pos;
+        size_t at = lowerEdge(current, uri, pos, len);
+
+        if (at == current.edges.size() || uri.compare(pos, len, current.edges[at].segment) != 0)
+            break;
+        node = current.edges[at].child;
+        if (server.location_trie[node].location != std::string::npos)
+            match = server.location_trie[node].location;
+        if (slash == std::string::npos)
+            break;
+        pos = slash + 1;
+    }
+    return match;
+}
@@ -5,6 +5,23 @@
 #include <string>
 #include <vector>
 #include <map>
+#include "FrozenConfig.hpp"
+
+// HTTP methods, one bit each so a location stores the allowed ones as a mask
+enum HttpMethod
+{
+    METHOD_UNKNOWN = 0,
+    METHOD_GET     = 1 << 0,
+    METHOD_POST    = 1 << 1,
+    METHOD_DELETE  = 1 << 2,
+    METHOD_HEAD    = 1 << 3,
+    METHOD_PUT     = 1 << 4,
+    METHOD_OPTIONS = 1 << 5
+};
+
+HttpMethod parseMethod(const char* name, size_t length);
+HttpMethod parseMethod(const std::string& name);
+const char* methodName(HttpMethod method);
 
 // Represents one location block (inside a server block)
 struct LocationConfig
@@ -12,13 +29,15 @@ struct LocationConfig
     std::string path;                  // location /this_path
     std::string root;                  // root /some/dir
     std::string index;                 // index.html
-    std::vector<std::string> methods; // GET, POST, DELETE
+    unsigned int methods;             // HttpMethod bits: GET, POST, DELETE
     bool autoindex;                   // on or off
     std::string upload_dir;           // where to store uploaded files
     std::string redirection;          // optional: redirect to another URL
     std::string cgi_extension;        // e.g. ".php", ".py"
+    long open_file_valid;             // ms, -1: the server's
+    long open_file_inactive;          // ms, -1: the server's
 
-    LocationConfig() : autoindex(false) {}
+    LocationConfig() : methods(0), autoindex(false), open_file_valid(-1), open_file_inactive(-1) {}
 };
 
 // Represents one server block
@@ -28,6 +47,22 @@ struct HostPort
     int listen_port;          // e.g. 80
 };
 
+// One edge of the location trie: a path segment leading to a child node
+struct LocationEdge
+{
+    std::string segment; // text between two '/'
+    size_t child;        // index in ServerConfig::location_trie
+};
+
+// One node of the location trie (node 0 is the root, before the first segment)
+struct LocationNode
+{
+    std::vector<LocationEdge> edges; // sorted by segment
+    size_t location;                 // index in ServerConfig::locations, npos if none ends here
+
+    LocationNode() : location(std::string::npos) {}
+};
+
 struct ServerConfig
 {
     std::vector<HostPort> listens; // e.g. "
@@ -35,15 +70,60 @@ struct ServerConfig
     std::map<int, std::string> error_pages; // 404 => "/404.html"
     std::vector<LocationConfig> locations;  // List of locations
     size_t max_body_size;
+    size_t open_file_cache;    // open fds kept for this server's files, 0: no cache
+    long open_file_valid;      // ms a cached fd is trusted before its path is checked again
+    long open_file_inactive;   // ms without use before a cached fd is closed
+    std::vector<LocationNode> location_trie; // built by compileRoutes
+    size_t root_location;                    // the "/" location, npos if none
+
+    ServerConfig()
+        : max_body_size(1000000), open_file_cache(0), open_file_valid(1000), open_file_inactive(20000),
+          root_location(std::string::npos) {} // example default: 1 MB
+};
+
+// One server_name entry of a port's host index (open addressing)
+struct NameSlot
+{
+    unsigned int hash;   // FNV-1a of name
+    std::string name;    // server_name as written in the config
+    size_t server;       // index in Config::servers, npos if the slot is empty
+
+    NameSlot() : hash(0), server(std::string::npos) {}
+};
+
+// Everything listening on one port: the default server + a hash index of names
+struct PortRoute
+{
+    size_t default_server;        // first server listening on this port
+    std::vector<NameSlot> names;  // power of two size, linear probing
+    size_t used;
+
+    PortRoute() : default_server(0), used(0) {}
+};
 
-    ServerConfig() : max_body_size(1000000) {} // example default: 1 MB
+// Compiled routing table, built once after parsing
+struct RouteTable
+{
+    std::map<int, PortRoute> ports; // listen_port => PortRoute
 };
 
 // Holds the full parsed config file
 struct Config
 {
     std::vector<ServerConfig> servers;
+    RouteTable routes;
+    FrozenConfig frozen;      // what the router reads, built by compileRoutes
+    unsigned long generation; // bumped by ConfigManager on every reload
+
+    Config() : generation(0) {}
 };
 
+unsigned int hashName(const std::string& name);
+void compileRoutes(Config& config);
+const PortRoute* findPort(const RouteTable& table, int port);
+size_t findServerByName(const PortRoute& route, const std::string& host);
+void compileLocations(ServerConfig& server);
+size_t findLocation(const ServerConfig& server, const std::string& uri);
+
 #endif // CONFIG_HPP
 
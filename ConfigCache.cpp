@@ -0,0 +1,402 @@
+#include "ConfigCache.hpp"
+#include "Parser.hpp"
+#include <stdint.h>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char CACHE_MAGIC[8] = { 'W', 'S', 'C', 'F', 'G', 'B', 'I', 'N' };
+static const uint32_t CACHE_VERSION = 3;    // bump on any layout change
+static const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+static const uint64_t CACHE_ALIGN = 8;      // every section starts on it: records hold 64-bit fields
+
+struct CacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;   // CACHE_BYTE_ORDER as written by the writer
+    int64_t source_mtime;
+    uint64_t source_size;
+    uint64_t source_hash;  // FNV-1a 64 of the source content
+    uint32_t server_count;
+    uint32_t listen_count;
+    uint32_t name_count;
+    uint32_t error_page_count;
+    uint32_t location_count;
+    uint32_t pool_size;
+};
+
+struct CacheString
+{
+    uint32_t offset; // in the pool
+    uint32_t length;
+};
+
+struct CacheServer
+{
+    uint32_t first_listen, listen_count;
+    uint32_t first_name, name_count;
+    uint32_t first_error_page, error_page_count;
+    uint32_t first_location, location_count;
+    uint64_t max_body_size;
+    uint64_t open_file_cache;
+    int64_t open_file_valid, open_file_inactive;
+};
+
+struct CacheListen
+{
+    CacheString host;
+    int32_t port;
+};
+
+struct CacheErrorPage
+{
+    int32_t code;
+    CacheString path;
+};
+
+struct CacheLocation
+{
+    CacheString path, root, index, upload_dir, redirection, cgi_extension;
+    uint32_t methods;
+    uint32_t autoindex;
+    int64_t open_file_valid, open_file_inactive;
+};
+
+// Read-only view of a whole file (mmap)
+struct MappedFile
+{
+    void* data;
+    size_t size;
+
+    MappedFile() : data(NULL), size(0) {}
+    ~MappedFile() {
+        if (data)
+            munmap(data, size);
+    }
+
+    bool open(const std::string& path, struct stat& s) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        if (fstat(fd, &s) != 0 || s.st_size <= 0)
+        {
+            close(fd);
+            return false;
+        }
+        void* map = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+            return false;
+        data = map;
+        size = s.st_size;
+        return true;
+    }
+};
+
+static uint64_t hashContent(const char* data, size_t size) {
+    uint64_t h = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// DO: Identify the current source: mtime, size and content hash
+static bool sourceKey(const std::string& sourcePath, int64_t& mtime, uint64_t& size, uint64_t& hash) {
+    MappedFile source;
+    struct stat s;
+
+    if (!source.open(sourcePath, s))
+        return false;
+    mtime = s.st_mtime;
+    size = s.st_size;
+    hash = hashContent(static_cast<const char*>(source.data), source.size);
+    return true;
+}
+
+std::string configCachePath(const std::string& sourcePath) {
+    return sourcePath + ".cache";
+}
+
+// Builds the record arrays and the pool in memory before writing them
+struct CacheWriter
+{
+    std::vector<CacheServer> servers;
+    std::vector<CacheListen> listens;
+    std::vector<CacheString> names;
+    std::vector<CacheErrorPage> error_pages;
+    std::vector<CacheLocation> locations;
+    std::string pool;
+
+    CacheString add(const std::string& s) {
+        CacheString ref;
+        ref.offset = pool.size();
+        ref.length = s.size();
+        pool += s;
+        return ref;
+    }
+};
+
+// RETURN: the bytes a section of that size takes in the file, padding included
+static uint64_t alignSection(uint64_t bytes) {
+    return (bytes + CACHE_ALIGN - 1) & ~(CACHE_ALIGN - 1);
+}
+
+// DO: Write a section, zero padded to CACHE_ALIGN so that the next one is aligned too
+static bool writeSection(FILE* f, const void* data, size_t bytes) {
+    static const char zeros[CACHE_ALIGN] = { 0 };
+    size_t padding = alignSection(bytes) - bytes;
+
+    return (!bytes || std::fwrite(data, 1, bytes, f) == bytes) && std::fwrite(zeros, 1, padding, f) == padding;
+}
+
+template <typename T>
+static bool writeArray(FILE* f, const std::vector<T>& v) {
+    return writeSection(f, v.empty() ? NULL : &v[0], sizeof(T) * v.size());
+}
+
+// DO: Serialize the config next to its source
+// RETURN: false if the cache could not be written (the server still runs, just without cache)
+bool writeConfigCache(const std::string& sourcePath, const Config& config) {
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.byte_order = CACHE_BYTE_ORDER;
+    if (!sourceKey(sourcePath, header.source_mtime, header.source_size, header.source_hash))
+        return false;
+
+    CacheWriter w;
+    for (size_t i = 0; i < config.servers.size(); ++i)
+    {
+        const ServerConfig& server = config.servers[i];
+        CacheServer rec;
+
+        rec.first_listen = w.listens.size();
+        rec.listen_count = server.listens.size();
+        for (size_t j = 0; j < server.listens.size(); ++j)
+        {
+            CacheListen l;
+            l.host = w.add(server.listens[j].listen_host);
+            l.port = server.listens[j].listen_port;
+            w.listens.push_back(l);
+        }
+        rec.first_name = w.names.size();
+        rec.name_count = server.server_name.size();
+        for (size_t j = 0; j < server.server_name.size(); ++j)
+            w.names.push_back(w.add(server.server_name[j]));
+        rec.first_error_page = w.error_pages.size();
+        rec.error_page_count = server.error_pages.size();
+        for (std::map<int, std::string>::const_iterator it = server.error_pages.begin(); it != server.error_pages.end(); ++it)
+        {
+            CacheErrorPage e;
+            e.code = it->first;
+            e.path = w.add(it->second);
+            w.error_pages.push_back(e);
+        }
+        rec.first_location = w.locations.size();
+        rec.location_count = server.locations.size();
+        for (size_t j = 0; j < server.locations.size(); ++j)
+        {
+            const LocationConfig& loc = server.locations[j];
+            CacheLocation l;
+            l.path = w.add(loc.path);
+            l.root = w.add(loc.root);
+            l.index = w.add(loc.index);
+            l.upload_dir = w.add(loc.upload_dir);
+            l.redirection = w.add(loc.redirection);
+            l.cgi_extension = w.add(loc.cgi_extension);
+            l.methods = loc.methods;
+            l.autoindex = loc.autoindex;
+            l.open_file_valid = loc.open_file_valid;
+            l.open_file_inactive = loc.open_file_inactive;
+            w.locations.push_back(l);
+        }
+        rec.max_body_size = server.max_body_size;
+        rec.open_file_cache = server.open_file_cache;
+        rec.open_file_valid = server.open_file_valid;
+        rec.open_file_inactive = server.open_file_inactive;
+        w.servers.push_back(rec);
+    }
+    header.server_count = w.servers.size();
+    header.listen_count = w.listens.size();
+    header.name_count = w.names.size();
+    header.error_page_count = w.error_pages.size();
+    header.location_count = w.locations.size();
+    header.pool_size = w.pool.size();
+
+    // written aside then renamed: a reader never maps a half written cache
+    std::string path = configCachePath(sourcePath);
+    std::string tmp = path + ".tmp";
+    FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = writeSection(f, &header, sizeof(header))
+        && writeArray(f, w.servers) && writeArray(f, w.listens) && writeArray(f, w.names)
+        && writeArray(f, w.error_pages) && writeArray(f, w.locations)
+        && std::fwrite(w.pool.data(), 1, w.pool.size(), f) == w.pool.size();
+    ok = (std::fclose(f) == 0) && ok;
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Bounds checked access to the pool of a mapped cache
+struct CacheReader
+{
+    const char* pool;
+    uint32_t pool_size;
+
+    bool get(const CacheString& ref, std::string& out) const {
+        if (ref.offset > pool_size || ref.length > pool_size - ref.offset)
+            return false;
+        out.assign(pool + ref.offset, ref.length);
+        return true;
+    }
+};
+
+// RETURN: the records of a section, read in place; NULL if they are not aligned for T
+    // the mapping is page aligned and writeArray pads every section, so only a corrupted cache gets NULL
+template <typename T>
+static const T* section(const char*& cursor, uint32_t count) {
+    const T* first = reinterpret_cast<const T*>(cursor);
+    cursor += alignSection((uint64_t)sizeof(T) * count);
+    if (reinterpret_cast<uintptr_t>(first) % __alignof__(T) != 0)
+        return NULL;
+    return first;
+}
+
+// DO: Load the config from its cache if the cache matches the source
+// RETURN: false if there is no valid cache (missing, stale, other version, corrupted)
+bool loadConfigCache(const std::string& sourcePath, Config& config) {
+    MappedFile cache;
+    struct stat s;
+
+    if (!cache.open(configCachePath(sourcePath), s) || cache.size < sizeof(CacheHeader))
+        return false;
+
+    const char* base = static_cast<const char*>(cache.data);
+    CacheHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+        || header.version != CACHE_VERSION || header.byte_order != CACHE_BYTE_ORDER)
+        return false;
+
+    // sizes first, so every section below is inside the mapping
+    uint64_t expected = alignSection(sizeof(CacheHeader))
+        + alignSection((uint64_t)header.server_count * sizeof(CacheServer))
+        + alignSection((uint64_t)header.listen_count * sizeof(CacheListen))
+        + alignSection((uint64_t)header.name_count * sizeof(CacheString))
+        + alignSection((uint64_t)header.error_page_count * sizeof(CacheErrorPage))
+        + alignSection((uint64_t)header.location_count * sizeof(CacheLocation))
+        + header.pool_size;
+    if (expected != cache.size)
+        return false;
+
+    int64_t mtime;
+    uint64_t size;
+    uint64_t hash;
+    if (!sourceKey(sourcePath, mtime, size, hash)
+        || mtime != header.source_mtime || size != header.source_size || hash != header.source_hash)
+        return false;
+
+    const char* cursor = base + alignSection(sizeof(CacheHeader));
+    const CacheServer* servers = section<CacheServer>(cursor, header.server_count);
+    const CacheListen* listens = section<CacheListen>(cursor, header.listen_count);
+    const CacheString* names = section<CacheString>(cursor, header.name_count);
+    const CacheErrorPage* error_pages = section<CacheErrorPage>(cursor, header.error_page_count);
+    const CacheLocation* locations = section<CacheLocation>(cursor, header.location_count);
+    if (!servers || !listens || !names || !error_pages || !locations)
+        return false;
+    CacheReader pool;
+    pool.pool = cursor;
+    pool.pool_size = header.pool_size;
+
+    Config loaded;
+    loaded.servers.resize(header.server_count);
+    for (uint32_t i = 0; i < header.server_count; ++i)
+    {
+        const CacheServer& rec = servers[i];
+        ServerConfig& server = loaded.servers[i];
+
+        if (rec.first_listen > header.listen_count || rec.listen_count > header.listen_count - rec.first_listen
+            || rec.first_name > header.name_count || rec.name_count > header.name_count - rec.first_name
+            || rec.first_error_page > header.error_page_count
+            || rec.error_page_count > header.error_page_count - rec.first_error_page
+            || rec.first_location > header.location_count
+            || rec.location_count > header.location_count - rec.first_location)
+            return false;
+
+        server.listens.resize(rec.listen_count);
+        for (uint32_t j = 0; j < rec.listen_count; ++j)
+        {
+            const CacheListen& l = listens[rec.first_listen + j];
+            if (!pool.get(l.host, server.listens[j].listen_host))
+                return false;
+            server.listens[j].listen_port = l.port;
+        }
+        server.server_name.resize(rec.name_count);
+        for (uint32_t j = 0; j < rec.name_count; ++j)
+            if (!pool.get(names[rec.first_name + j], server.server_name[j]))
+                return false;
+        for (uint32_t j = 0; j < rec.error_page_count; ++j)
+        {
+            const CacheErrorPage& e = error_pages[rec.first_error_page + j];
+            if (!pool.get(e.path, server.error_pages[e.code]))
+                return false;
+        }
+        server.locations.resize(rec.location_count);
+        for (uint32_t j = 0; j < rec.location_count; ++j)
+        {
+            const CacheLocation& l = locations[rec.first_location + j];
+            LocationConfig& loc = server.locations[j];
+            if (!pool.get(l.path, loc.path) || !pool.get(l.root, loc.root) || !pool.get(l.index, loc.index)
+                || !pool.get(l.upload_dir, loc.upload_dir) || !pool.get(l.redirection, loc.redirection)
+                || !pool.get(l.cgi_extension, loc.cgi_extension))
+                return false;
+            loc.methods = l.methods;
+            loc.autoindex = l.autoindex != 0;
+            loc.open_file_valid = l.open_file_valid;
+            loc.open_file_inactive = l.open_file_inactive;
+        }
+        server.max_body_size = rec.max_body_size;
+        server.open_file_cache = rec.open_file_cache;
+        server.open_file_valid = rec.open_file_valid;
+        server.open_file_inactive = rec.open_file_inactive;
+    }
+    if (loaded.servers.empty())
+        return false;
+
+    config.servers.swap(loaded.servers);
+    compileRoutes(config);
+    return true;
+}
+
+// DO: Load a config: from its cache when it is up to date, else parse it and refresh the cache
+Config loadConfig(const std::string& sourcePath) {
+    Config config;
+
+    if (!loadConfigCache(sourcePath, config))
+    {
+        Tokenizer tokenizer(sourcePath, true);
+        Parser parser(tokenizer);
+        config = parser.parseParallel();
+        writeConfigCache(sourcePath, config);
+    }
+    // error pages are files of their own: read on every load, never cached
+    std::vector<std::string> failures = loadErrorPages(config);
+    for (size_t i = 0; i < failures.size(); ++i)
+        std::cerr << "Warning: " << failures[i] << ", using the built-in page" << std::endl;
+    return config;
+}
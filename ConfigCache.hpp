@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include "Config.hpp"
+
+// Binary config cache, written next to the config file (<config>.cache)
+    // valid while the source has the same mtime, size and content hash: startup then skips tokenize + parse
+    // layout (native endianness, every offset from the start of the file):
+    //   CacheHeader | servers | listens | names | error pages | locations | string pool
+    // each string is an (offset, length) pair into the pool, which is one region at the end
+std::string configCachePath(const std::string& sourcePath);
+bool loadConfigCache(const std::string& sourcePath, Config& config);
+bool writeConfigCache(const std::string& sourcePath, const Config& config);
+Config loadConfig(const std::string& sourcePath);
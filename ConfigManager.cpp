@@ -0,0 +1,180 @@
+#include "ConfigManager.hpp"
+#include "ConfigCache.hpp"
+#include <stdexcept>
+
+ConfigManager::ConfigManager(const std::string& filePath)
+    : _path(filePath), _current(NULL), _generation(0), _threadRunning(false), _threadDone(0)
+{
+    for (size_t i = 0; i < MAX_READERS; ++i)
+    {
+        _slots[i].pinned = NULL;
+        _slots[i].used = 0;
+    }
+    pthread_mutex_init(&_writer, NULL);
+
+    try {
+        _current = load();
+    }
+    catch (...) {
+        pthread_mutex_destroy(&_writer);
+        throw;
+    }
+}
+
+ConfigManager::~ConfigManager()
+{
+    waitReload();
+    delete _current;
+    for (size_t i = 0; i < _retired.size(); ++i)
+        delete _retired[i];
+    pthread_mutex_destroy(&_writer);
+}
+
+// DO: Parse the file with the usual Tokenizer/Parser (or take it from its binary cache)
+// RETURN: a new snapshot (throws the parse error)
+Config* ConfigManager::load()
+{
+    Config* config = new Config(loadConfig(_path));
+
+    config->generation = ++_generation;
+    return config;
+}
+
+// DO: Reload the config file and publish it if it parses
+// RETURN: false if the parse failed, the current snapshot then stays active
+bool ConfigManager::reload()
+{
+    pthread_mutex_lock(&_writer);
+
+    Config* fresh = NULL;
+    try {
+        fresh = load();
+    }
+    catch (const std::exception& e) {
+        _error = e.what();
+        pthread_mutex_unlock(&_writer);
+        return false;
+    }
+    _error.clear();
+
+    // from here new readers see fresh, the old one waits in _retired
+    Config* old = __atomic_exchange_n(&_current, fresh, __ATOMIC_SEQ_CST);
+    _retired.push_back(old);
+    pthread_mutex_unlock(&_writer);
+
+    collect();
+    return true;
+}
+
+void* ConfigManager::reloadThread(void* arg)
+{
+    ConfigManager* manager = static_cast<ConfigManager*>(arg);
+
+    manager->reload();
+    __atomic_store_n(&manager->_threadDone, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// RETURN: false if the previous background reload is still parsing
+bool ConfigManager::reloadInBackground()
+{
+    if (_threadRunning)
+    {
+        if (!__atomic_load_n(&_threadDone, __ATOMIC_ACQUIRE))
+            return false;
+        waitReload();
+    }
+    _threadDone = 0;
+    if (pthread_create(&_thread, NULL, &ConfigManager::reloadThread, this) != 0)
+        return false;
+    _threadRunning = true;
+    return true;
+}
+
+void ConfigManager::waitReload()
+{
+    if (!_threadRunning)
+        return;
+    pthread_join(_thread, NULL);
+    _threadRunning = false;
+}
+
+// DO: Delete every retired snapshot that no reader has pinned
+void ConfigManager::collect()
+{
+    pthread_mutex_lock(&_writer);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < _retired.size(); ++i)
+    {
+        bool pinned = false;
+        for (size_t s = 0; s < MAX_READERS && !pinned; ++s)
+            pinned = (__atomic_load_n(&_slots[s].pinned, __ATOMIC_SEQ_CST) == _retired[i]);
+
+        if (pinned)
+            _retired[kept++] = _retired[i];
+        else
+            delete _retired[i];
+    }
+    _retired.resize(kept);
+
+    pthread_mutex_unlock(&_writer);
+}
+
+unsigned long ConfigManager::generation() const
+{
+    return __atomic_load_n(&_current, __ATOMIC_ACQUIRE)->generation;
+}
+
+std::string ConfigManager::lastError()
+{
+    pthread_mutex_lock(&_writer);
+    std::string error = _error;
+    pthread_mutex_unlock(&_writer);
+    return error;
+}
+
+// Claims a free hazard slot
+ConfigReader::ConfigReader(ConfigManager& manager)
+    : _manager(manager), _slot(NULL)
+{
+    for (size_t i = 0; i < ConfigManager::MAX_READERS; ++i)
+    {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&manager._slots[i].used, &expected, 1,
+                                        false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        {
+            _slot = &manager._slots[i];
+            return;
+        }
+    }
+    throw std::runtime_error("Too many config readers");
+}
+
+ConfigReader::~ConfigReader()
+{
+    release();
+    __atomic_store_n(&_slot->used, 0, __ATOMIC_SEQ_CST);
+}
+
+// DO: Pin the current snapshot
+    // publish it in our slot, then check it is still current: if a reload swapped it in between,
+    // the writer may not have seen our slot, so try again with the new one
+const Config& ConfigReader::acquire()
+{
+    Config* config = __atomic_load_n(&_manager._current, __ATOMIC_SEQ_CST);
+
+    while (true)
+    {
+        __atomic_store_n(&_slot->pinned, config, __ATOMIC_SEQ_CST);
+        Config* again = __atomic_load_n(&_manager._current, __ATOMIC_SEQ_CST);
+        if (again == config)
+            return *config;
+        config = again;
+    }
+}
+
+void ConfigReader::release()
+{
+    __atomic_store_n(&_slot->pinned, static_cast<Config*>(NULL), __ATOMIC_SEQ_CST);
+}
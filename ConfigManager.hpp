@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "Config.hpp"
+
+// ConfigManager: owns the live Config and swaps in a new one on reload, without stopping readers
+    // readers never lock: each worker thread pins the current snapshot in its own hazard slot,
+    // a replaced snapshot is only deleted once no slot points to it anymore
+    // a reload that fails to parse keeps the current snapshot (lastError() tells why)
+class ConfigManager
+{
+public:
+    static const size_t MAX_READERS = 256;
+
+    ConfigManager(const std::string& filePath); // first load, throws if it fails
+    ~ConfigManager();                           // readers must be gone
+
+    bool reload();                // parse filePath again and publish it
+    bool reloadInBackground();    // same on another thread, false if one is still running
+    void waitReload();            // join the background reload
+    void collect();               // delete the replaced snapshots nobody reads
+
+    unsigned long generation() const;
+    std::string lastError();
+
+private:
+    friend class ConfigReader;
+
+    // one per reader, alone on its cache line
+    struct Slot
+    {
+        Config* pinned;  // snapshot being read, NULL when idle
+        int used;        // 1 once a ConfigReader owns the slot
+        char pad[64 - sizeof(Config*) - sizeof(int)];
+    };
+
+    std::string _path;
+    Config* _current;
+    Slot _slots[MAX_READERS];
+
+    pthread_mutex_t _writer;        // reloads and _retired
+    std::vector<Config*> _retired;  // replaced, maybe still read
+    unsigned long _generation;
+    std::string _error;
+
+    pthread_t _thread;
+    bool _threadRunning;  // _thread was started and not joined yet
+    int _threadDone;      // set by _thread when its reload is over
+
+    Config* load();
+    static void* reloadThread(void* arg);
+
+    ConfigManager(const ConfigManager&);
+    ConfigManager& operator=(const ConfigManager&);
+};
+
+// ConfigReader: one per worker thread, reads the live config of a ConfigManager
+    // const Config& config = reader.acquire(); ... routingResult(config, ...) ...; reader.release();
+    // the config stays valid until release(), even if a reload happens meanwhile
+class ConfigReader
+{
+public:
+    ConfigReader(ConfigManager& manager);
+    ~ConfigReader();
+
+    const Config& acquire();
+    void release();
+
+private:
+    ConfigManager& _manager;
+    ConfigManager::Slot* _slot;
+
+    ConfigReader(const ConfigReader&);
+    ConfigReader& operator=(const ConfigReader&);
+};
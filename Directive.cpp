@@ -0,0 +1,79 @@
+#include "Directive.hpp"
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <pthread.h>
+
+// Directive names, indexed by Directive
+#define DIRECTIVE_NAME(id, name, server, location) name,
+static const char* const g_names[DIR_COUNT] = {
+    "",
+    DIRECTIVES(DIRECTIVE_NAME)
+};
+#undef DIRECTIVE_NAME
+
+// Perfect hash of the directive names
+    // the slot table is twice a power of two above DIR_COUNT, and the seed is picked by initDirectives()
+    // so that no two names share a slot: a lookup is one hash, one slot read and one memcmp
+static const unsigned int SLOTS = 64;
+
+static unsigned int g_seed = 0;
+static unsigned char g_slots[SLOTS]; // Directive, DIR_NONE if the slot is free
+
+static unsigned int hashWord(unsigned int seed, const char* word, size_t length) {
+    unsigned int h = 2166136261u ^ seed;
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        h ^= static_cast<unsigned char>(word[i]);
+        h *= 16777619u;
+    }
+    return (h ^ (h >> 15)) & (SLOTS - 1);
+}
+
+static bool trySeed(unsigned int seed) {
+    std::memset(g_slots, DIR_NONE, sizeof(g_slots));
+
+    for (int d = DIR_NONE + 1; d < DIR_COUNT; ++d)
+    {
+        unsigned int slot = hashWord(seed, g_names[d], std::strlen(g_names[d]));
+        if (g_slots[slot] != DIR_NONE)
+            return false;
+        g_slots[slot] = static_cast<unsigned char>(d);
+    }
+    return true;
+}
+
+// DO: Search the first seed without collisions
+    // run once through pthread_once, not from a static constructor: a lookup from another
+    // translation unit's static initializer (or from a parser thread) must not see an empty table
+static void buildTable() {
+    for (g_seed = 0; g_seed < 100000; ++g_seed)
+        if (trySeed(g_seed))
+            return;
+    std::cerr << "Directive table: no perfect hash seed, grow SLOTS" << std::endl;
+    std::abort();
+}
+
+static pthread_once_t g_table = PTHREAD_ONCE_INIT;
+
+// DO: Build the lookup table, once per process
+    // the Tokenizer and TokenStream constructors call it, so the lookup of each word needs no check
+void initDirectives() {
+    pthread_once(&g_table, buildTable);
+}
+
+// DO: Classify a word of the config file
+// RETURN: its Directive, or DIR_NONE if it is not a keyword
+    // initDirectives() must have run
+Directive lookupDirective(const char* word, size_t length) {
+    Directive d = static_cast<Directive>(g_slots[hashWord(g_seed, word, length)]);
+
+    if (d != DIR_NONE && std::strlen(g_names[d]) == length && std::memcmp(g_names[d], word, length) == 0)
+        return d;
+    return DIR_NONE;
+}
+
+const char* directiveName(Directive directive) {
+    return g_names[directive];
+}
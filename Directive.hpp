@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+
+// DIRECTIVES: every keyword of the config language, with the Parser member that reads it
+    // in a server block and in a location block (0 where it is not allowed)
+    // to add a directive: add one row here and write its handlers
+    // expanded into the Directive enum, the names of Directive.cpp and the handler tables of Parser.cpp
+#define DIRECTIVES(X) \
+    X(SERVER,                   "server",                   0,                              0) \
+    X(LISTEN,                   "listen",                   &Parser::parseListen,           0) \
+    X(SERVER_NAME,              "server_name",              &Parser::parseServerName,       0) \
+    X(LOCATION,                 "location",                 &Parser::parseLocation,         0) \
+    X(ERROR_PAGE,               "error_page",               &Parser::parseErrorPage,        0) \
+    X(MAX_BODY_SIZE,            "max_body_size",            &Parser::parseMaxBodySize,      0) \
+    X(ROOT,                     "root",                     0,  &Parser::parseLocationRoot) \
+    X(INDEX,                    "index",                    0,  &Parser::parseLocationIndex) \
+    X(AUTOINDEX,                "autoindex",                0,  &Parser::parseLocationAutoindex) \
+    X(METHODS,                  "methods",                  0,  &Parser::parseLocationMethods) \
+    X(UPLOAD_DIR,               "upload_dir",               0,  &Parser::parseLocationUpload) \
+    X(REDIRECTION,              "redirection",              0,  &Parser::parseLocationRedirect) \
+    X(CGI_EXTENSION,            "cgi_extension",            0,  &Parser::parseLocationCGI) \
+    X(OPEN_FILE_CACHE,          "open_file_cache",          &Parser::parseOpenFileCache,    0) \
+    X(OPEN_FILE_CACHE_VALID,    "open_file_cache_valid",    &Parser::parseOpenFileValid, \
+                                                            &Parser::parseLocationOpenFileValid) \
+    X(OPEN_FILE_CACHE_INACTIVE, "open_file_cache_inactive", &Parser::parseOpenFileInactive, \
+                                                            &Parser::parseLocationOpenFileInactive)
+
+#define DIRECTIVE_ENUM(id, name, server, location) DIR_##id,
+
+enum Directive
+{
+    DIR_NONE,           // not a keyword
+    DIRECTIVES(DIRECTIVE_ENUM)
+    DIR_COUNT
+};
+
+#undef DIRECTIVE_ENUM
+
+void initDirectives();
+Directive lookupDirective(const char* word, size_t length);
+const char* directiveName(Directive directive);
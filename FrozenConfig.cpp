@@ -0,0 +1,435 @@
+#include "FrozenConfig.hpp"
+#include "Config.hpp"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+// Interns strings in the arena: the same text is stored once
+struct Interner
+{
+    std::string& arena;
+    std::map<std::string, FrozenString> seen;
+
+    Interner(std::string& a) : arena(a) {}
+
+    FrozenString add(const std::string& s) {
+        std::map<std::string, FrozenString>::iterator it = seen.find(s);
+        if (it != seen.end())
+            return it->second;
+
+        FrozenString ref;
+        ref.offset = arena.size();
+        ref.length = s.size();
+        arena += s;
+        seen[s] = ref;
+        return ref;
+    }
+};
+
+static const char REDIRECT_HEAD[] = "HTTP/1.1 302 Found\r\nLocation: ";
+
+// The URL of a redirection location
+    // the tokenizer keeps the quotes of redirection = "url": they are not part of it
+static std::string redirectUrl(const std::string& redirection) {
+    if (redirection.size() >= 2 && redirection[0] == '"' && redirection[redirection.size() - 1] == '"')
+        return redirection.substr(1, redirection.size() - 2);
+    return redirection;
+}
+
+// The bytes sent for a redirection location: status line, headers and an empty body
+    // the URL starts sizeof(REDIRECT_HEAD) - 1 bytes in
+static std::string redirectResponse(const std::string& url) {
+    return REDIRECT_HEAD + url + "\r\nContent-Length: 0\r\n\r\n";
+}
+
+// Reason phrase of an HTTP status
+static const char* reasonPhrase(int code) {
+    switch (code)
+    {
+        case 300: return "Multiple Choices";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 303: return "See Other";
+        case 304: return "Not Modified";
+        case 307: return "Temporary Redirect";
+        case 308: return "Permanent Redirect";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 406: return "Not Acceptable";
+        case 408: return "Request Timeout";
+        case 409: return "Conflict";
+        case 410: return "Gone";
+        case 411: return "Length Required";
+        case 413: return "Payload Too Large";
+        case 414: return "URI Too Long";
+        case 415: return "Unsupported Media Type";
+        case 416: return "Range Not Satisfiable";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        case 505: return "HTTP Version Not Supported";
+    }
+    return code < 400 ? "Redirection" : code < 500 ? "Client Error" : "Server Error";
+}
+
+// The bytes sent for an error: status line, headers and body
+static std::string errorResponse(int code, const std::string& body) {
+    std::ostringstream out;
+    out << "HTTP/1.1 " << code << ' ' << reasonPhrase(code) << "\r\n"
+        << "Content-Type: text/html\r\n"
+        << "Content-Length: " << body.size() << "\r\n\r\n"
+        << body;
+    return out.str();
+}
+
+// Built-in page of a code without a configured error_page
+static std::string defaultErrorBody(int code) {
+    std::ostringstream title;
+    title << code << ' ' << reasonPhrase(code);
+    return "<html>\r\n<head><title>" + title.str() + "</title></head>\r\n<body>\r\n<center><h1>"
+           + title.str() + "</h1></center>\r\n</body>\r\n</html>\r\n";
+}
+
+// DO: Read a whole file
+// RETURN: false if it can't be opened or read
+static bool readFile(const std::string& path, std::string& content) {
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file)
+        return false;
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    if (file.bad())
+        return false;
+    content = buffer.str();
+    return true;
+}
+
+// DO: Fill frozen.error_responses with the built-in pages, one row per server and one for no server
+    // no I/O here: the configured error_page files are read by loadErrorPages, once per config load
+static void freezeErrorResponses(const Config& config, FrozenConfig& frozen, Interner& strings) {
+    std::vector<FrozenString> defaults(FrozenConfig::ERROR_CODES);
+    for (int code = FrozenConfig::ERROR_FIRST; code <= FrozenConfig::ERROR_LAST; ++code)
+        defaults[code - FrozenConfig::ERROR_FIRST] = strings.add(errorResponse(code, defaultErrorBody(code)));
+
+    frozen.error_responses.reserve((config.servers.size() + 1) * FrozenConfig::ERROR_CODES);
+    for (size_t s = 0; s <= config.servers.size(); ++s)
+        frozen.error_responses.insert(frozen.error_responses.end(), defaults.begin(), defaults.end());
+}
+
+// DO: Read the configured error pages into config.frozen (after compileRoutes, before serving)
+    // an error_page path is a uri of the server (like nginx): it is routed to its file and read now,
+    // later edits of the file show up with the next load; the arena grows, so run it before any
+    // errorResponse() bytes are handed out
+// RETURN: one message per page that could not be loaded: that code keeps the built-in page
+std::vector<std::string> loadErrorPages(Config& config) {
+    FrozenConfig& frozen = config.frozen;
+    std::vector<std::string> failures;
+
+    for (size_t s = 0; s < config.servers.size(); ++s)
+    {
+        size_t row = s * FrozenConfig::ERROR_CODES;
+        const std::map<int, std::string>& pages = config.servers[s].error_pages;
+        for (std::map<int, std::string>::const_iterator it = pages.begin(); it != pages.end(); ++it)
+        {
+            std::ostringstream page;
+            page << "error_page " << it->first << ' ' << it->second << ": ";
+            if (it->first < FrozenConfig::ERROR_FIRST || it->first > FrozenConfig::ERROR_LAST)
+            {
+                failures.push_back(page.str() + "only 4xx and 5xx codes have an error page");
+                continue;
+            }
+            uint32_t loc = frozenLocation(frozen, s, it->second);
+            if (loc == FrozenConfig::NO_LOCATION)
+            {
+                failures.push_back(page.str() + "no location matches");
+                continue;
+            }
+            uint32_t global = frozen.servers[s].first_location + loc;
+            if (frozen.loc_flags[global] & LOC_REDIRECT)
+            {
+                failures.push_back(page.str() + "its location is a redirection");
+                continue;
+            }
+
+            std::string path;
+            std::string body;
+            frozenPath(frozen, global, it->second, path);
+            if (!readFile(path, body))
+            {
+                failures.push_back(page.str() + "cannot read " + path);
+                continue;
+            }
+            FrozenString& response = frozen.error_responses[row + it->first - FrozenConfig::ERROR_FIRST];
+            std::string bytes = errorResponse(it->first, body);
+            response.offset = frozen.arena.size();
+            response.length = bytes.size();
+            frozen.arena += bytes;
+        }
+    }
+    return failures;
+}
+
+static uint32_t local(size_t index) {
+    return index == std::string::npos ? FrozenConfig::NO_LOCATION : static_cast<uint32_t>(index);
+}
+
+// DO: Build config.frozen from the parsed servers and their location tries (after compileLocations)
+void freezeConfig(Config& config) {
+    config.frozen = FrozenConfig();
+    FrozenConfig& frozen = config.frozen;
+    Interner strings(frozen.arena);
+
+    for (size_t i = 0; i < config.servers.size(); ++i)
+    {
+        const ServerConfig& server = config.servers[i];
+        FrozenServer fs;
+
+        fs.first_location = frozen.loc_flags.size();
+        fs.location_count = server.locations.size();
+        for (size_t j = 0; j < server.locations.size(); ++j)
+        {
+            const LocationConfig& loc = server.locations[j];
+            unsigned char flags = 0;
+
+            if (loc.autoindex)
+                flags |= LOC_AUTOINDEX;
+            if (!loc.redirection.empty())
+                flags |= LOC_REDIRECT;
+            if (!loc.index.empty())
+                flags |= LOC_INDEX;
+            FrozenJoin join;
+            join.root = strings.add(loc.root);
+            join.strip = loc.path.size();
+            join.root_slash = !loc.root.empty() && loc.root[loc.root.size() - 1] == '/';
+            if (!loc.index.empty())
+                join.index_suffix = strings.add("/" + loc.index);
+            frozen.loc_join.push_back(join);
+            // the URL is stored once, in the response: loc_redirection is its Location value
+            std::string url = redirectUrl(loc.redirection);
+            FrozenString response;
+            FrozenString location;
+            if (!loc.redirection.empty())
+            {
+                response = strings.add(redirectResponse(url));
+                location.offset = response.offset + sizeof(REDIRECT_HEAD) - 1;
+                location.length = url.size();
+            }
+            frozen.loc_redirection.push_back(location);
+            frozen.loc_redirect_response.push_back(response);
+            frozen.loc_methods.push_back(loc.methods);
+            frozen.loc_flags.push_back(flags);
+            bool cached = server.open_file_cache > 0;
+            frozen.loc_open_valid.push_back(!cached ? -1 : loc.open_file_valid >= 0 ? loc.open_file_valid : server.open_file_valid);
+            frozen.loc_open_inactive.push_back(!cached ? -1 : loc.open_file_inactive >= 0 ? loc.open_file_inactive : server.open_file_inactive);
+        }
+
+        // the trie keeps its shape, node k of the server becomes root_node + k
+        fs.root_node = frozen.nodes.size();
+        fs.root_location = local(server.root_location);
+        for (size_t n = 0; n < server.location_trie.size(); ++n)
+        {
+            const LocationNode& node = server.location_trie[n];
+            FrozenNode fn;
+
+            fn.first_edge = frozen.edges.size();
+            fn.edge_count = node.edges.size();
+            fn.location = local(node.location);
+            for (size_t e = 0; e < node.edges.size(); ++e)
+            {
+                FrozenEdge fe;
+                fe.segment = strings.add(node.edges[e].segment);
+                fe.child = fs.root_node + node.edges[e].child;
+                frozen.edges.push_back(fe);
+            }
+            frozen.nodes.push_back(fn);
+        }
+
+        // std::map iterates by code: the array is sorted
+        fs.first_error_page = frozen.error_pages.size();
+        fs.error_page_count = server.error_pages.size();
+        for (std::map<int, std::string>::const_iterator it = server.error_pages.begin(); it != server.error_pages.end(); ++it)
+        {
+            FrozenErrorPage page;
+            page.code = it->first;
+            page.path = strings.add(it->second);
+            frozen.error_pages.push_back(page);
+        }
+        frozen.servers.push_back(fs);
+    }
+    freezeErrorResponses(config, frozen, strings);
+}
+
+// uri[pos, pos + len) compared to a segment, like std::string::compare
+static int compareSegment(const FrozenConfig& frozen, const std::string& uri, size_t pos, size_t len, const FrozenString& seg) {
+    size_t n = len < seg.length ? len : seg.length;
+    int c = n ? std::memcmp(uri.data() + pos, frozen.data(seg), n) : 0;
+
+    if (c)
+        return c;
+    if (len == seg.length)
+        return 0;
+    return len < seg.length ? -1 : 1;
+}
+
+// DO: Longest location of a server matching the uri (same walk as findLocation, on the frozen trie)
+// RETURN: the local location index, NO_LOCATION if none
+    // with a cursor the walk starts from the deepest step the previous uri shares with this one
+uint32_t frozenLocation(const FrozenConfig& frozen, size_t server, const std::string& uri, TrieCursor* cursor) {
+    const FrozenServer& fs = frozen.servers[server];
+    uint32_t match = FrozenConfig::NO_LOCATION;
+
+    if (!uri.empty() && uri[0] == '/')
+        match = fs.root_location;
+    if (fs.root_node >= frozen.nodes.size())
+        return match;
+
+    uint32_t node = fs.root_node;
+    size_t pos = 0;
+
+    if (cursor)
+    {
+        if (cursor->uri && cursor->server == server)
+        {
+            const std::string& last = *cursor->uri;
+            size_t common = 0;
+            while (common < last.size() && common < uri.size() && last[common] == uri[common])
+                ++common;
+            while (!cursor->steps.empty() && cursor->steps.back().next > common)
+                cursor->steps.pop_back();
+            if (!cursor->steps.empty())
+            {
+                node = cursor->steps.back().node;
+                pos = cursor->steps.back().next;
+                match = cursor->steps.back().match;
+            }
+        }
+        else
+            cursor->steps.clear();
+        cursor->server = server;
+        cursor->uri = &uri;
+    }
+
+    while (true)
+    {
+        const FrozenNode& current = frozen.nodes[node];
+        size_t slash = uri.find('/', pos);
+        size_t len = (slash == std::string::npos ? uri.size() : slash) - pos;
+
+        // binary search of the segment among the sorted edges
+        uint32_t lo = current.first_edge;
+        uint32_t hi = current.first_edge + current.edge_count;
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (compareSegment(frozen, uri, pos, len, frozen.edges[mid].segment) > 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo == current.first_edge + current.edge_count
+            || compareSegment(frozen, uri, pos, len, frozen.edges[lo].segment) != 0)
+            break;
+
+        node = frozen.edges[lo].child;
+        if (frozen.nodes[node].location != FrozenConfig::NO_LOCATION)
+            match = frozen.nodes[node].location;
+        if (slash == std::string::npos)
+            break;
+        pos = slash + 1;
+        if (cursor)
+        {
+            TrieCursor::Step step;
+            step.node = node;
+            step.next = pos;
+            step.match = match;
+            cursor->steps.push_back(step);
+        }
+    }
+    return match;
+}
+
+// DO: Binary search of a status code in the server's error pages
+// RETURN: false if the server has no page for that code
+bool frozenErrorPage(const FrozenConfig& frozen, size_t server, int code, FrozenString& path) {
+    const FrozenServer& fs = frozen.servers[server];
+    uint32_t lo = fs.first_error_page;
+    uint32_t hi = fs.first_error_page + fs.error_page_count;
+
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (frozen.error_pages[mid].code < code)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == fs.first_error_page + fs.error_page_count || frozen.error_pages[lo].code != code)
+        return false;
+    path = frozen.error_pages[lo].path;
+    return true;
+}
+
+// Where the rest of the uri starts once the location path (and a doubled slash) is cut
+static size_t joinSkip(const FrozenJoin& join, const std::string& uri) {
+    size_t skip = join.strip;
+
+    if (join.root_slash && skip < uri.size() && uri[skip] == '/')
+        ++skip;
+    return skip < uri.size() ? skip : uri.size();
+}
+
+// DO: The prebuilt response of an error code for a server (server = servers.size(): no server)
+// RETURN: the bytes in the arena; codes out of ERROR_FIRST..ERROR_LAST get the 500 page
+const FrozenString& frozenErrorResponse(const FrozenConfig& frozen, size_t server, int code) {
+    if (code < FrozenConfig::ERROR_FIRST || code > FrozenConfig::ERROR_LAST)
+        code = 500;
+    if (server > frozen.servers.size())
+        server = frozen.servers.size();
+    return frozen.error_responses[server * FrozenConfig::ERROR_CODES + code - FrozenConfig::ERROR_FIRST];
+}
+
+// DO: root + (uri - location path), like finalPath, from the frozen location (global index)
+    // one allocation at most: room for the index suffix is reserved too, so appending it later is free
+void frozenPath(const FrozenConfig& frozen, uint32_t location, const std::string& uri, std::string& path) {
+    const FrozenJoin& join = frozen.loc_join[location];
+    size_t skip = joinSkip(join, uri);
+
+    path.reserve(join.root.length + uri.size() - skip + join.index_suffix.length);
+    path.assign(frozen.data(join.root), join.root.length);
+    path.append(uri, skip, std::string::npos);
+}
+
+// DO: Same path, written NUL-terminated into a caller buffer: no allocation
+// RETURN: the path length; >= size means it did not fit and buffer is left unspecified
+size_t frozenPath(const FrozenConfig& frozen, uint32_t location, const std::string& uri, char* buffer, size_t size) {
+    const FrozenJoin& join = frozen.loc_join[location];
+    size_t skip = joinSkip(join, uri);
+    size_t length = join.root.length + uri.size() - skip;
+
+    if (length >= size)
+        return length;
+    std::memcpy(buffer, frozen.data(join.root), join.root.length);
+    std::memcpy(buffer + join.root.length, uri.data() + skip, uri.size() - skip);
+    buffer[length] = '\0';
+    return length;
+}
+
+// DO: Append "/" + index of the location to the path of `length` chars already in buffer, NUL-terminated
+// RETURN: the new length; >= size means it did not fit and buffer is left unspecified
+size_t frozenIndexPath(const FrozenConfig& frozen, uint32_t location, char* buffer, size_t length, size_t size) {
+    const FrozenString& suffix = frozen.loc_join[location].index_suffix;
+    size_t total = length + suffix.length;
+
+    if (total >= size)
+        return total;
+    std::memcpy(buffer + length, frozen.data(suffix), suffix.length);
+    buffer[total] = '\0';
+    return total;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+struct Config;
+
+// A string interned in FrozenConfig::arena
+struct FrozenString
+{
+    uint32_t offset;
+    uint32_t length;
+
+    FrozenString() : offset(0), length(0) {}
+};
+
+// Location flags
+enum
+{
+    LOC_AUTOINDEX = 1 << 0,
+    LOC_REDIRECT  = 1 << 1,
+    LOC_INDEX     = 1 << 2
+};
+
+// How a location turns a uri into a path on disk, precomputed by freezeConfig
+    // path = root + uri[strip..], one '/' less when root ends with '/' and the rest starts with one
+struct FrozenJoin
+{
+    FrozenString root;
+    uint32_t strip;            // location path length
+    bool root_slash;           // root ends with '/'
+    FrozenString index_suffix; // "/" + index, empty without index
+};
+
+struct FrozenServer
+{
+    uint32_t first_location;   // global location index of locations[0]
+    uint32_t location_count;
+    uint32_t root_node;        // trie node before the first segment
+    uint32_t root_location;    // local index of the "/" location, NO_LOCATION if none
+    uint32_t first_error_page; // in error_pages, sorted by code
+    uint32_t error_page_count;
+};
+
+struct FrozenNode
+{
+    uint32_t first_edge;
+    uint32_t edge_count;
+    uint32_t location;         // local index in the server, NO_LOCATION if none ends here
+};
+
+struct FrozenEdge
+{
+    FrozenString segment;
+    uint32_t child;
+};
+
+struct FrozenErrorPage
+{
+    int32_t code;
+    FrozenString path;
+};
+
+// FrozenConfig: read-only copy of what routing reads, built after parsing (freezeConfig)
+    // every string lives once in one arena, locations are struct-of-arrays indexed by a global
+    // location number (first_location + local index), trie nodes/edges and error pages are flat arrays
+    // so a lookup touches a few contiguous arrays instead of one heap block per string
+struct FrozenConfig
+{
+    static const uint32_t NO_LOCATION = 0xffffffffu;
+
+    std::string arena;
+    std::vector<FrozenServer> servers;
+
+    // locations, struct of arrays
+    std::vector<FrozenJoin> loc_join;
+    std::vector<FrozenString> loc_redirection;
+    std::vector<FrozenString> loc_redirect_response; // the whole 302 response, empty without redirection
+    std::vector<unsigned int> loc_methods; // HttpMethod bits
+    std::vector<unsigned char> loc_flags;  // LOC_*
+    std::vector<long> loc_open_valid;      // open file cache times (ms), inherited from the server,
+    std::vector<long> loc_open_inactive;   // -1 when the server has no open_file_cache
+
+    std::vector<FrozenNode> nodes;
+    std::vector<FrozenEdge> edges;
+    std::vector<FrozenErrorPage> error_pages;
+
+    // complete error responses (status line, headers, body) of codes ERROR_FIRST..ERROR_LAST
+    // (4xx and 5xx only: 1xx, 204, 304 and 3xx responses must not be a page with a body),
+    // ERROR_CODES per server then one row of built-in pages: the page of `code` for server s
+    // is error_responses[s * ERROR_CODES + code - ERROR_FIRST], s = servers.size() for no server
+    static const int ERROR_FIRST = 400;
+    static const int ERROR_LAST = 599;
+    static const int ERROR_CODES = ERROR_LAST - ERROR_FIRST + 1;
+    std::vector<FrozenString> error_responses;
+
+    const char* data(const FrozenString& s) const { return arena.data() + s.offset; }
+    std::string str(const FrozenString& s) const { return std::string(data(s), s.length); }
+};
+
+// TrieCursor: remembers a location walk so the next uri can resume it where both uris still agree
+    // (a batch sorts its uris, neighbours share most of their segments)
+    // the previous uri is not copied: it must stay alive until the next walk
+struct TrieCursor
+{
+    struct Step
+    {
+        uint32_t node;   // node reached after a segment followed by '/'
+        size_t next;     // where the next segment starts (after that '/')
+        uint32_t match;  // longest location found so far
+    };
+
+    size_t server;
+    const std::string* uri;
+    std::vector<Step> steps;
+
+    TrieCursor() : server(0), uri(NULL) {}
+};
+
+void freezeConfig(Config& config);
+std::vector<std::string> loadErrorPages(Config& config);
+uint32_t frozenLocation(const FrozenConfig& frozen, size_t server, const std::string& uri, TrieCursor* cursor = NULL);
+bool frozenErrorPage(const FrozenConfig& frozen, size_t server, int code, FrozenString& path);
+const FrozenString& frozenErrorResponse(const FrozenConfig& frozen, size_t server, int code);
+void frozenPath(const FrozenConfig& frozen, uint32_t location, const std::string& uri, std::string& path);
+size_t frozenPath(const FrozenConfig& frozen, uint32_t location, const std::string& uri, char* buffer, size_t size);
+size_t frozenIndexPath(const FrozenConfig& frozen, uint32_t location, char* buffer, size_t length, size_t size);
@@ -0,0 +1,175 @@
+#include "OpenFileCache.hpp"
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// DO: Open a path the way a static response needs it
+    // O_NONBLOCK: opening a FIFO must not wait for a writer; only regular files keep their fd
+static void openPath(OpenFile& file) {
+    struct stat s;
+    int fd = open(file.path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+    if (fd < 0 || fstat(fd, &s) != 0)
+    {
+        bool denied = (fd < 0 && errno == EACCES);
+        if (fd >= 0)
+            close(fd);
+        // can't open: still tell routing whether it exists and is a directory
+        file.probe = probePath(file.path);
+        if (denied)
+            file.probe.readable = false;
+        return;
+    }
+    file.probe.exists = true;
+    file.probe.directory = S_ISDIR(s.st_mode);
+    file.probe.readable = true;
+    file.probe.size = s.st_size;
+    file.probe.mtime = s.st_mtime;
+    file.device = s.st_dev;
+    file.inode = s.st_ino;
+    file.mtime = s.st_mtim;
+    if (S_ISREG(s.st_mode))
+        file.fd = fd;
+    else
+        close(fd);
+}
+
+// RETURN: true if path still names the file behind fd, unchanged
+static bool stillValid(const OpenFile& file) {
+    struct stat s;
+
+    if (file.fd < 0 || stat(file.path.c_str(), &s) != 0)
+        return false;
+    return s.st_dev == file.device && s.st_ino == file.inode && s.st_size == file.probe.size
+           && s.st_mtim.tv_sec == file.mtime.tv_sec && s.st_mtim.tv_nsec == file.mtime.tv_nsec;
+}
+
+static void destroy(OpenFile* file) {
+    if (file->fd >= 0)
+        close(file->fd);
+    delete file;
+}
+
+OpenFileCache::OpenFileCache(size_t capacity)
+    : _capacity(capacity), _nextExpiry(0) {}
+
+// fds still acquired stay open (a sendfile() may still run on them): they are detached, the last release() closes them
+OpenFileCache::~OpenFileCache()
+{
+    for (Position it = _order.begin(); it != _order.end(); ++it)
+    {
+        (*it)->cached = false;
+        if (!(*it)->refs)
+            destroy(*it);
+    }
+}
+
+// DO: Drop an entry from the cache, closing it unless a request still uses it
+void OpenFileCache::evict(Position position) {
+    OpenFile* file = *position;
+
+    _index.erase(file->path);
+    _order.erase(position);
+    file->cached = false;
+    if (!file->refs)
+        destroy(file);
+}
+
+// DO: Close what was not used for its inactive time
+    // inactive is per location, so the order of last use says nothing about the order of expiry: the
+    // whole list is scanned, only once the earliest expiry seen by the previous scan is reached
+    // an expired entry still acquired only leaves the cache, its fd is closed by the last release()
+void OpenFileCache::expire(long now) {
+    if (now < _nextExpiry)
+        return;
+    _nextExpiry = LONG_MAX;
+    for (Position it = _order.begin(); it != _order.end();)
+    {
+        Position position = it++;
+        long expiry = (*position)->used + (*position)->inactive;
+        if (now >= expiry)
+        {
+            evict(position);
+            ++_stats.evictions;
+        }
+        else if (expiry < _nextExpiry)
+            _nextExpiry = expiry;
+    }
+}
+
+// DO: Mark a file used now, for inactive_ms more
+void OpenFileCache::touch(OpenFile* file, long now, long valid_ms, long inactive_ms) {
+    file->used = now;
+    file->valid = valid_ms;
+    file->inactive = inactive_ms;
+    if (now + inactive_ms < _nextExpiry)
+        _nextExpiry = now + inactive_ms;
+}
+
+// DO: The opened path, from the cache while it is valid
+// RETURN: never NULL; fd is -1 for a missing file, a directory or anything but a regular file
+OpenFile* OpenFileCache::acquire(const std::string& path, long valid_ms, long inactive_ms) {
+    long now = monotonicMs();
+    expire(now);
+
+    std::map<std::string, Position>::iterator it = _index.find(path);
+    if (it != _index.end())
+    {
+        OpenFile* file = *it->second;
+        bool fresh = now - file->checked < file->valid;
+        if (!fresh && stillValid(*file))
+        {
+            file->checked = now;
+            fresh = true;
+        }
+        if (fresh)
+        {
+            ++_stats.hits;
+            _order.splice(_order.begin(), _order, it->second);
+            touch(file, now, valid_ms, inactive_ms);
+            ++file->refs;
+            return file;
+        }
+        evict(it->second);
+        ++_stats.evictions;
+    }
+    ++_stats.misses;
+
+    OpenFile* file = new OpenFile();
+    file->path = path;
+    openPath(*file);
+    file->checked = now;
+    file->refs = 1;
+    touch(file, now, valid_ms, inactive_ms);
+    if (!_capacity)
+        return file; // no cache: closed by release()
+
+    if (_order.size() >= _capacity)
+    {
+        evict(--_order.end());
+        ++_stats.evictions;
+    }
+    _order.push_front(file);
+    _index[path] = _order.begin();
+    file->cached = true;
+    return file;
+}
+
+// static: it only looks at the file, so it can run after the cache is gone
+void OpenFileCache::release(OpenFile* file) {
+    if (!file)
+        return;
+    if (--file->refs == 0 && !file->cached)
+        destroy(file);
+}
+
+// RETURN: the entries an OpenFileCache should have for this config: the sum of the servers' open_file_cache
+size_t openFileCacheCapacity(const Config& config) {
+    size_t capacity = 0;
+
+    for (size_t i = 0; i < config.servers.size(); ++i)
+        capacity += config.servers[i].open_file_cache;
+    return capacity;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <list>
+#include <ctime>
+#include "RouteCache.hpp"
+
+// One opened path, shared by every request serving it
+struct OpenFile
+{
+    int fd;            // open regular file, ready for sendfile(); -1 for anything else
+    FileProbe probe;   // what routing needs to know about the path
+
+    // cache bookkeeping
+    std::string path;
+    dev_t device;
+    ino_t inode;
+    struct timespec mtime;
+    long checked;      // ms, monotonic: last time the path was compared to fd
+    long used;         // ms, monotonic: last acquire()
+    long valid;        // ms trusted without looking at the path again
+    long inactive;     // ms without use before eviction
+    unsigned int refs; // acquire() not released yet
+    bool cached;       // false once evicted: the last release() closes it
+
+    OpenFile() : fd(-1), device(0), inode(0), checked(0), used(0), valid(0), inactive(0), refs(0), cached(false) {
+        mtime.tv_sec = 0;
+        mtime.tv_nsec = 0;
+    }
+};
+
+// OpenFileCache: open fds by path, so a file routed to is neither stat-ed nor opened again for every request
+    // open_file_cache (entries), open_file_cache_valid and open_file_cache_inactive set it up per server / location:
+    // an fd older than `valid` is checked against its path (device, inode, size and mtime) and reopened if they moved,
+    // an fd unused for `inactive` is closed; past capacity the least recently used one goes
+    // an fd stays open while acquired, even if evicted meanwhile or the cache is destroyed: every acquire() needs its release()
+    // not thread safe: one per worker thread
+class OpenFileCache
+{
+public:
+    OpenFileCache(size_t capacity);
+    ~OpenFileCache();
+
+    OpenFile* acquire(const std::string& path, long valid_ms, long inactive_ms);
+    static void release(OpenFile* file);
+
+    size_t size() const { return _order.size(); }
+    const CacheStats& stats() const { return _stats; }
+
+private:
+    typedef std::list<OpenFile*>::iterator Position;
+
+    size_t _capacity;
+    std::list<OpenFile*> _order; // most recently used first
+    std::map<std::string, Position> _index;
+    CacheStats _stats;
+    long _nextExpiry; // ms, monotonic clock: no entry expires before it
+
+    void evict(Position position);
+    void expire(long now);
+    void touch(OpenFile* file, long now, long valid_ms, long inactive_ms);
+
+    OpenFileCache(const OpenFileCache&);
+    OpenFileCache& operator=(const OpenFileCache&);
+};
+
+size_t openFileCacheCapacity(const Config& config);
@@ -1,7 +1,7 @@
 #include "Parser.hpp"
 
 void Parser::parseLocationRoot(LocationConfig& loc) {
-    Token val = get();
+    const Token& val = get();
     if (val.type != VALUE)
         throw std::runtime_error("Expected value for root directive");
     if (val.text.empty())
@@ -15,7 +15,7 @@ void Parser::parseLocationRoot(LocationConfig& loc) {
 }
 
 void Parser::parseLocationIndex(LocationConfig& loc) {
-    Token val = get();
+    const Token& val = get();
     if (val.type != VALUE)
         throw std::runtime_error("Expected value for index directive");
     if (val.text.empty())
@@ -32,7 +32,7 @@ void Parser::parseLocationIndex(LocationConfig& loc) {
 }
 
 void Parser::parseLocationAutoindex(LocationConfig& loc) {
-    Token val = get();
+    const Token& val = get();
     if (val.type != VALUE)
         throw std::runtime_error("Expected value for autoindex directive");
     if (val.text == "on") {
@@ -49,18 +49,20 @@ void Parser::parseLocationAutoindex(LocationConfig& loc) {
 
 void Parser::parseLocationMethods(LocationConfig& loc) {
 
-    std::set<std::string> methodDup_set;
+    // only these can be allowed in the config
+    static const unsigned int allowed = METHOD_GET | METHOD_POST | METHOD_DELETE;
 
     while (peek().type == VALUE) {
-        Token method = get();
-        if (method.text != "GET" && method.text != "POST" && method.text != "DELETE")
+        const Token& method = get();
+        HttpMethod m = parseMethod(method.text);
+        if (!(m & allowed))
             throw std::runtime_error("Invalid method: " + method.text);
             
-        if (!methodDup_set.insert(method.text).second)
+        if (loc.methods & m)
             throw std::runtime_error("Duplicate method: " + method.text);
-        loc.methods.push_back(method.text);
+        loc.methods |= m;
     }
-    if (loc.methods.empty())
+    if (!loc.methods)
         throw std::runtime_error("At least one method must be specified");
 
     if (get().type != SEMICOLON)
@@ -68,7 +70,7 @@ void Parser::parseLocationMethods(LocationConfig& loc) {
 }
 
 void Parser::parseLocationUpload(LocationConfig& loc) {
-    Token val = get();
+    const Token& val = get();
     if (val.type != VALUE)
         throw std::runtime_error("Expected value for upload_dir");
     if (val.text.empty())
@@ -86,7 +88,7 @@ void Parser::parseLocationRedirect(LocationConfig& loc) {
     if (get().type != EQUAL)
         throw std::runtime_error("Expected '=' after redirection");
 
-    Token val = get();
+    const Token& val = get();
     if (val.type != VALUE)
         throw std::runtime_error("Expected URL after '='");
     if (val.text.empty())
@@ -98,7 +100,7 @@ void Parser::parseLocationRedirect(LocationConfig& loc) {
 }
 
 void Parser::parseLocationCGI(LocationConfig& loc) {
-    Token val = get();
+    const Token& val = get();
     if (val.type != VALUE)
         throw std::runtime_error("Expected value for cgi_extension");
     if (val.text.empty())
@@ -111,3 +113,12 @@ void Parser::parseLocationCGI(LocationConfig& loc) {
     if (get().type != SEMICOLON)
         throw std::runtime_error("Expected ';' after cgi_extension");
 }
+
+// Same as the server directives, for the files of this location only
+void Parser::parseLocationOpenFileValid(LocationConfig& loc) {
+    loc.open_file_valid = parseNumberValue("open_file_cache_valid");
+}
+
+void Parser::parseLocationOpenFileInactive(LocationConfig& loc) {
+    loc.open_file_inactive = parseNumberValue("open_file_cache_inactive");
+}
@@ -0,0 +1,169 @@
+#include "Parser.hpp"
+#include <pthread.h>
+#include <unistd.h>
+
+// Shared by the workers of one parseParallel call
+struct ParallelJob
+{
+    const std::vector<Token>* tokens;  // token list mode: ranges are token indexes
+    const Tokenizer* tokenizer;        // view mode: ranges are byte offsets in its text
+    const std::vector<size_t>* bounds; // range k is [bounds[k], bounds[k + 1])
+    Config* config;                    // servers[k] is filled by the worker that takes range k
+    pthread_mutex_t lock;
+    size_t next;                       // next range to hand out
+    bool failed;                       // a range failed: stop and let the serial parser report it
+};
+
+// DO: Split the tokens into one range per top-level block by matching braces
+// RETURN: false when the file can't be split cleanly (unbalanced braces, stray tokens...)
+    // the serial parser then runs alone, so the error message is the usual one
+    // in view mode the raw text is split: the ranges are byte offsets, and nothing is copied
+bool Parser::splitServers(std::vector<size_t>& bounds) const {
+    if (_tokenizer)
+        return splitText(bounds);
+    const std::vector<Token>& tokens = *_source;
+    size_t i = _index;
+
+    bounds.clear();
+    bounds.push_back(i);
+    while (i < _end && tokens[i].type != END_OF_FILE)
+    {
+        // 'server' then '{'
+        if (tokens[i].directive != DIR_SERVER || i + 1 >= _end || tokens[i + 1].type != BRACE_OPEN)
+            return false;
+        i += 2;
+
+        size_t depth = 1;
+        while (depth && i < _end && tokens[i].type != END_OF_FILE)
+        {
+            if (tokens[i].type == BRACE_OPEN)
+                ++depth;
+            else if (tokens[i].type == BRACE_CLOSE)
+                --depth;
+            ++i;
+        }
+        if (depth)
+            return false;
+        bounds.push_back(i);
+    }
+    return true;
+}
+
+bool Parser::splitText(std::vector<size_t>& bounds) const {
+    size_t pos = _pos;
+
+    bounds.clear();
+    bounds.push_back(pos);
+    while (true)
+    {
+        TokenView token = _tokenizer->view(pos, _limit);
+        if (token.type == END_OF_FILE)
+            return true;
+        if (token.directive != DIR_SERVER || _tokenizer->view(pos, _limit).type != BRACE_OPEN)
+            return false;
+
+        // inside the block only the braces matter, and a word never holds one: scan the bytes
+        const char* text = _tokenizer->data();
+        size_t depth = 1;
+        for (; depth && pos < _limit; ++pos)
+        {
+            if (text[pos] == '{')
+                ++depth;
+            else if (text[pos] == '}')
+                --depth;
+        }
+        if (depth)
+            return false;
+        bounds.push_back(pos);
+    }
+}
+
+void* Parser::parseWorker(void* arg) {
+    ParallelJob& job = *static_cast<ParallelJob*>(arg);
+
+    while (true)
+    {
+        pthread_mutex_lock(&job.lock);
+        size_t k = job.next++;
+        bool stop = job.failed;
+        pthread_mutex_unlock(&job.lock);
+
+        if (stop || k + 1 >= job.bounds->size())
+            return NULL;
+
+        size_t begin = (*job.bounds)[k];
+        size_t end = (*job.bounds)[k + 1];
+        Parser worker(job.tokens, job.tokenizer, begin, end);
+        bool ok = true;
+        try {
+            worker.parseServerBlock(job.config->servers[k]);
+            // the block must end on its own closing brace
+            ok = job.tokenizer ? (!worker._peeked && worker._pos == end) : (worker._index == end);
+        }
+        catch (const std::exception&) {
+            ok = false;
+        }
+        if (!ok)
+        {
+            pthread_mutex_lock(&job.lock);
+            job.failed = true;
+            pthread_mutex_unlock(&job.lock);
+        }
+    }
+}
+
+// DO: Parse the server blocks on a pool of threads (0: one per CPU)
+// RETURN: the same Config as parse(), servers in file order
+    // 1. a brace matching pre-scan cuts the tokens into server block ranges
+    // 2. each worker takes the next range and parses it straight into config.servers[k]
+    // 3. if anything goes wrong we parse again serially: the error is exactly the serial one
+Config Parser::parseParallel(size_t threads) {
+    std::vector<size_t> bounds;
+
+    if (threads == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? static_cast<size_t>(cpus) : 1;
+    }
+    // one thread: the pre-scan would be pure overhead
+    // the streaming mode can't be split: its tokens are read once, in order
+    if (threads < 2 || _stream || _peeked || !splitServers(bounds) || bounds.size() < 3)
+        return parse();
+    if (threads > bounds.size() - 1)
+        threads = bounds.size() - 1;
+
+    Config config;
+    config.servers.resize(bounds.size() - 1);
+
+    ParallelJob job;
+    job.tokens = _source;
+    job.tokenizer = _tokenizer;
+    job.bounds = &bounds;
+    job.config = &config;
+    job.next = 0;
+    job.failed = false;
+    pthread_mutex_init(&job.lock, NULL);
+
+    // the calling thread is one of the workers
+    std::vector<pthread_t> pool;
+    for (size_t i = 1; i < threads; ++i)
+    {
+        pthread_t t;
+        if (pthread_create(&t, NULL, &Parser::parseWorker, &job) == 0)
+            pool.push_back(t);
+    }
+    parseWorker(&job);
+    for (size_t i = 0; i < pool.size(); ++i)
+        pthread_join(pool[i], NULL);
+    pthread_mutex_destroy(&job.lock);
+
+    if (job.failed)
+        return parse();
+
+    if (_tokenizer)
+        _pos = bounds.back();
+    else
+        _index = bounds.back();
+    compileRoutes(config);
+    return config;
+}
@@ -1,18 +1,99 @@
 #include "Parser.hpp"
 // #include <stdexcept>
 
-Token Parser::peek() {
-    if (_index < _tokens.size())
-        return _tokens[_index];
-    return Token(END_OF_FILE, "");
+// Reads the tokens in place from the tokenizer's text (mapped or read): no token list, no copy of the file
+    // the tokenizer must outlive the parser
+Parser::Parser(Tokenizer& tokenizer)
+    : _index(0), _source(&_tokens), _end(0), _stream(NULL),
+      _tokenizer(&tokenizer), _pos(0), _limit(tokenizer.size()),
+      _current(END_OF_FILE, ""), _lookahead(END_OF_FILE, ""), _peeked(false) {}
+
+// Pulls the tokens from the stream while parsing: an error is thrown as soon as the bad token is read
+Parser::Parser(TokenStream& stream)
+    : _index(0), _source(&_tokens), _end(0), _stream(&stream),
+      _tokenizer(NULL), _pos(0), _limit(0),
+      _current(END_OF_FILE, ""), _lookahead(END_OF_FILE, ""), _peeked(false) {}
+
+// Reads [begin, end) of another parser's tokens, or the bytes [begin, end) of a tokenizer's text,
+    // without copying them
+Parser::Parser(const std::vector<Token>* source, const Tokenizer* tokenizer, size_t begin, size_t end)
+    : _index(tokenizer ? 0 : begin), _source(tokenizer ? &_tokens : source), _end(tokenizer ? 0 : end),
+      _stream(NULL), _tokenizer(tokenizer), _pos(tokenizer ? begin : 0), _limit(tokenizer ? end : 0),
+      _current(END_OF_FILE, ""), _lookahead(END_OF_FILE, ""), _peeked(false) {}
+
+// Returned when reading past the last token
+static const Token& endToken() {
+    static const Token eof(END_OF_FILE, "");
+    return eof;
+}
+
+// DO: Read the next token of the stream or of the tokenizer's text into token
+    // its string capacity is reused: once the longest token was seen, reading one allocates nothing
+void Parser::pull(Token& token) {
+    if (_stream)
+    {
+        _stream->next(token);
+        return;
+    }
+    TokenView view = _tokenizer->view(_pos, _limit);
+    token.type = view.type;
+    token.directive = view.directive;
+    token.text.assign(_tokenizer->data() + view.offset, view.length);
 }
 
-Token Parser::get() {
-    if (_index < _tokens.size())
-        return _tokens[_index++];
-    return Token(END_OF_FILE, "");
+// peek/get hand out references into the tokens (valid as long as the parser lives)
+    // in streaming and view mode the token of get() is valid until the next get(), the one of peek() until get()
+const Token& Parser::peek() {
+    if (_stream || _tokenizer)
+    {
+        if (!_peeked)
+        {
+            pull(_lookahead);
+            _peeked = true;
+        }
+        return _lookahead;
+    }
+    if (_index < _end)
+        return (*_source)[_index];
+    return endToken();
+}
+
+const Token& Parser::get() {
+    if (_stream || _tokenizer)
+    {
+        if (_peeked)
+        {
+            _current.type = _lookahead.type;
+            _current.directive = _lookahead.directive;
+            _current.text.swap(_lookahead.text);
+            _peeked = false;
+        }
+        else
+            pull(_current);
+        return _current;
+    }
+    if (_index < _end)
+        return (*_source)[_index++];
+    return endToken();
 }
 
+// Handlers of the directives allowed directly in a server block, and in a location block (see DIRECTIVES)
+#define DIRECTIVE_SERVER(id, name, server, location) server,
+#define DIRECTIVE_LOCATION(id, name, server, location) location,
+
+const Parser::ServerHandler Parser::_serverHandlers[DIR_COUNT] = {
+    NULL,                       // DIR_NONE
+    DIRECTIVES(DIRECTIVE_SERVER)
+};
+
+const Parser::LocationHandler Parser::_locationHandlers[DIR_COUNT] = {
+    NULL,                       // DIR_NONE
+    DIRECTIVES(DIRECTIVE_LOCATION)
+};
+
+#undef DIRECTIVE_SERVER
+#undef DIRECTIVE_LOCATION
+
 //PARSING SECTION
 // Parses the entire configuration file and returns a Config object
 
@@ -25,44 +106,38 @@ Config Parser::parse() {
 
     if (config.servers.empty())
         throw std::runtime_error("No server blocks found in configuration");
-    
+
+    compileRoutes(config);
     return config;
 }
 
 void Parser::parseServer(Config& config) {
-    Token t = get();
-    if (t.type != KEYWORD || t.text != "server")
+    // parsed in place: no copy of the server and its locations
+    config.servers.push_back(ServerConfig());
+    parseServerBlock(config.servers.back());
+}
+
+void Parser::parseServerBlock(ServerConfig& server) {
+    const Token& t = get();
+    if (t.type != KEYWORD || t.directive != DIR_SERVER)
         throw std::runtime_error("Expected 'server' keyword");
     
     if (get().type != BRACE_OPEN)
         throw std::runtime_error("Expected '{' after server");
     
-    ServerConfig server;
-    
     while (peek().type != BRACE_CLOSE && peek().type != END_OF_FILE)
     {
-        Token key = get();
+        const Token& key = get();
         
         if (key.type != KEYWORD)
             throw std::runtime_error("Expected directive inside server block");
         
-        if (key.text == "listen") {
-            parseListen(server);
-        } else if (key.text == "server_name") {
-            parseServerName(server);
-        } else if (key.text == "location") {
-            parseLocation(server);
-        } else if (key.text == "error_page") {
-            parseErrorPage(server);
-        } else if (key.text == "max_body_size") {
-            parseMaxBodySize(server);
-        } else {
+        ServerHandler handler = _serverHandlers[key.directive];
+        if (!handler)
             throw std::runtime_error("Unknown server directive: " + key.text);
-        }
+        (this->*handler)(server);
     }
     
     if (get().type != BRACE_CLOSE)
         throw std::runtime_error("Expected '}' at end of server block");
-    
-    config.servers.push_back(server);
 }
@@ -3,7 +3,6 @@
 #include <vector>
 #include <string>
 #include <cstdlib>
-#include <set>
 #include "Tokenizer.hpp"
 #include "Config.hpp"
 
@@ -11,18 +10,51 @@ class Parser
 {
 public:
     Parser(const std::vector<Token>& tokens) 
-        : _tokens(tokens), _index(0) {};
+        : _tokens(tokens), _index(0), _source(&_tokens), _end(_tokens.size()), _stream(NULL),
+          _tokenizer(NULL), _pos(0), _limit(0),
+          _current(END_OF_FILE, ""), _lookahead(END_OF_FILE, ""), _peeked(false) {};
+    Parser(Tokenizer& tokenizer);
+    Parser(TokenStream& stream);
     Config parse();
+    Config parseParallel(size_t threads = 0);
 
 private:
     std::vector<Token> _tokens;
     size_t _index;
+    const std::vector<Token>* _source; // _tokens, or the tokens of the parser that started this one
+    size_t _end;                       // tokens are read from [_index, _end)
 
-    Token get();
-    Token peek();
+    // streaming mode: tokens are pulled one at a time, _tokens stays empty
+    TokenStream* _stream;
+    // view mode: tokens are read in place from the tokenizer's text, bytes [_pos, _limit)
+    const Tokenizer* _tokenizer;
+    size_t _pos;
+    size_t _limit;
+    Token _current;   // last token returned by get()
+    Token _lookahead; // token returned by peek(), valid when _peeked
+    bool _peeked;
+
+    // Directive dispatch, indexed by Directive (NULL: not allowed in that block)
+    typedef void (Parser::*ServerHandler)(ServerConfig&);
+    typedef void (Parser::*LocationHandler)(LocationConfig&);
+    static const ServerHandler _serverHandlers[DIR_COUNT];
+    static const LocationHandler _locationHandlers[DIR_COUNT];
+
+    // worker of parseParallel: parses one server block range, of source's tokens or of tokenizer's text
+    Parser(const std::vector<Token>* source, const Tokenizer* tokenizer, size_t begin, size_t end);
+    Parser(const Parser&);
+    Parser& operator=(const Parser&);
+
+    void pull(Token& token);
+    const Token& get();
+    const Token& peek();
 
     // Helper functions
     void parseServer(Config& config);
+    void parseServerBlock(ServerConfig& server);
+    bool splitServers(std::vector<size_t>& bounds) const;
+    bool splitText(std::vector<size_t>& bounds) const;
+    static void* parseWorker(void* arg);
     void parseListen(ServerConfig& server);
     void parseServerName(ServerConfig& server);
     void parseLocation(ServerConfig& server);
@@ -35,6 +67,12 @@ private:
     void parseLocationCGI(LocationConfig& loc);
     void parseErrorPage(ServerConfig& server);
     void parseMaxBodySize(ServerConfig& server);
+    void parseOpenFileCache(ServerConfig& server);
+    void parseOpenFileValid(ServerConfig& server);
+    void parseOpenFileInactive(ServerConfig& server);
+    void parseLocationOpenFileValid(LocationConfig& loc);
+    void parseLocationOpenFileInactive(LocationConfig& loc);
+    long parseNumberValue(const char* directive);
 
 };
 
@@ -1,7 +1,7 @@
 #include "Parser.hpp"
 
 void Parser::parseListen(ServerConfig& server) {
-    Token val = get();
+    const Token& val = get();
     if (val.type != VALUE)
         throw std::runtime_error("Expected value for listen directive");
 
@@ -26,7 +26,7 @@ void Parser::parseListen(ServerConfig& server) {
 }
 
 void Parser::parseServerName(ServerConfig& server) {
-    Token val = get();
+    const Token& val = get();
     if (val.type != VALUE)
         throw std::runtime_error("Expected value for server_name directive");
 
@@ -42,7 +42,7 @@ void Parser::parseServerName(ServerConfig& server) {
 void Parser::parseLocation(ServerConfig& server) {
     LocationConfig loc;
     
-    Token path = get();
+    const Token& path = get();
     if (path.type != VALUE)
         throw std::runtime_error("Expected value for location path");
 
@@ -51,56 +51,19 @@ void Parser::parseLocation(ServerConfig& server) {
     if (get().type != BRACE_OPEN)
     throw std::runtime_error("Expected '{' after location path");
 
-    bool root_seen = false;
-    bool index_seen = false;
-    bool autoindex_seen = false;
-    bool methods_seen = false;
-    bool upload_seen = false;
-    bool redirect_seen = false;
-    bool cgi_seen = false;
+    unsigned int seen = 0; // one bit per Directive already parsed in this block
     
     while (peek().type != BRACE_CLOSE && peek().type != END_OF_FILE) {
-        Token lkey = get();
+        const Token& lkey = get();
         
-        if (lkey.text == "root") {
-            if (root_seen)
-                throw std::runtime_error("Duplicate root directive in location block");
-            root_seen = true;
-            parseLocationRoot(loc);
-        } else if (lkey.text == "index") {
-            if (index_seen)
-                throw std::runtime_error("Duplicate index directive in location block");
-            index_seen = true;
-            parseLocationIndex(loc);
-        } else if (lkey.text == "autoindex") {
-            if (autoindex_seen)
-                throw std::runtime_error("Duplicate autoindex directive in location block");
-            autoindex_seen = true;
-            parseLocationAutoindex(loc);
-        } else if (lkey.text == "methods") {
-            if (methods_seen)
-                throw std::runtime_error("Duplicate methods directive in location block");
-            methods_seen = true;
-            parseLocationMethods(loc);
-        } else if (lkey.text == "upload_dir") {
-            if (upload_seen)
-                throw std::runtime_error("Duplicate upload_dir directive in location block");
-            upload_seen = true;
-            parseLocationUpload(loc);
-        } else if (lkey.text == "redirection") {
-            if (redirect_seen)
-                throw std::runtime_error("Duplicate redirection directive in location block");
-            redirect_seen = true;
-            parseLocationRedirect(loc);
-        } else if (lkey.text == "cgi_extension") {
-            if (cgi_seen)
-                throw std::runtime_error("Duplicate cgi_extension directive in location block");
-            cgi_seen = true;
-            parseLocationCGI(loc);
-        } else {
+        LocationHandler handler = _locationHandlers[lkey.directive];
+        if (!handler)
             throw std::runtime_error("Unknown location directive: " + lkey.text);
-        }
-}
+        if (seen & (1u << lkey.directive))
+            throw std::runtime_error(std::string("Duplicate ") + directiveName(lkey.directive) + " directive in location block");
+        seen |= 1u << lkey.directive;
+        (this->*handler)(loc);
+    }
 
     if (get().type != BRACE_CLOSE)
         throw std::runtime_error("Expected '}' at end of location block");
@@ -110,7 +73,7 @@ void Parser::parseLocation(ServerConfig& server) {
 
 void Parser::parseErrorPage(ServerConfig& server) {
     // Step 1: Get the error code (should be numeric)
-    Token codeToken = get();
+    const Token& codeToken = get();
     if (codeToken.type != VALUE)
         throw std::runtime_error("Expected status code for error_page");
 
@@ -119,7 +82,7 @@ void Parser::parseErrorPage(ServerConfig& server) {
         throw std::runtime_error("Invalid status code for error_page: " + codeToken.text);
 
     // Step 2: Get the file path
-    Token fileToken = get();
+    const Token& fileToken = get();
     if (fileToken.type != VALUE)
         throw std::runtime_error("Expected path for error_page");
 
@@ -136,7 +99,7 @@ void Parser::parseErrorPage(ServerConfig& server) {
 }
 
 void Parser::parseMaxBodySize(ServerConfig& server) {
-    Token val = get();
+    const Token& val = get();
     if (val.type != VALUE)
         throw std::runtime_error("Expected value for client_max_body_size");
 
@@ -159,3 +122,37 @@ void Parser::parseMaxBodySize(ServerConfig& server) {
 }
 
 
+// DO: Read `<number>;` for a numeric directive
+// RETURN: the number (0 to 999999999)
+long Parser::parseNumberValue(const char* directive) {
+    const Token& val = get();
+    if (val.type != VALUE || val.text.empty())
+        throw std::runtime_error(std::string("Expected number for ") + directive);
+    if (val.text.length() > 9)
+        throw std::runtime_error(std::string(directive) + " is too large");
+    for (size_t i = 0; i < val.text.length(); ++i) {
+        if (!std::isdigit(val.text[i]))
+            throw std::runtime_error(std::string(directive) + " must be a positive number");
+    }
+
+    long number = std::atol(val.text.c_str());
+
+    if (get().type != SEMICOLON)
+        throw std::runtime_error(std::string("Expected ';' after ") + directive);
+    return number;
+}
+
+// open_file_cache <entries>;  0 turns the cache off
+void Parser::parseOpenFileCache(ServerConfig& server) {
+    server.open_file_cache = parseNumberValue("open_file_cache");
+}
+
+// open_file_cache_valid <ms>;
+void Parser::parseOpenFileValid(ServerConfig& server) {
+    server.open_file_valid = parseNumberValue("open_file_cache_valid");
+}
+
+// open_file_cache_inactive <ms>;
+void Parser::parseOpenFileInactive(ServerConfig& server) {
+    server.open_file_inactive = parseNumberValue("open_file_cache_inactive");
+}
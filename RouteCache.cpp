@@ -0,0 +1,95 @@
+#include "RouteCache.hpp"
+#include "RouteStats.hpp"
+#include <sstream>
+#include <ctime>
+
+long monotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+StatCache::StatCache(size_t capacity, long ttl_ms)
+    : _entries(capacity), _ttl(ttl_ms) {}
+
+// DO: Find the cached probe of a path, or probe it and cache the answer
+const FileProbe& StatCache::probe(const std::string& path) {
+    long now = monotonicMs();
+    Entry* cached = _entries.find(path);
+
+    if (cached && cached->expires > now)
+    {
+        ++_stats.hits;
+        return cached->file;
+    }
+    ++_stats.misses;
+
+    Entry entry;
+    entry.file = probePath(path);
+    entry.expires = now + _ttl;
+
+    if (_entries.insert(path, entry))
+        ++_stats.evictions;
+    return _entries.find(path)->file;
+}
+
+void StatCache::clear() {
+    _entries.clear();
+}
+
+RouteCache::RouteCache(size_t capacity, size_t stat_capacity, long ttl_ms)
+    : _entries(capacity), _files(stat_capacity, ttl_ms), _config(NULL), _generation(0), _ttl(ttl_ms) {}
+
+// DO: Route a request through the cache
+// RETURN: the same RoutingResult as routingResult(), or throws the same error
+RoutingResult RouteCache::route(const Config& config, const std::string& host,
+                        int port, const std::string& uri, const std::string& method)
+{
+    RoutingResult result = resolve(config, host, port, uri, method);
+
+    throwRouteError(result, uri, method);
+    return result;
+}
+
+// DO: Same as route() without throwing (see resolveRoute)
+RoutingResult RouteCache::resolve(const Config& config, const std::string& host,
+                        int port, const std::string& uri, const std::string& method)
+{
+    // a reloaded snapshot may be allocated where the old one was: check the generation too
+    if (&config != _config || config.generation != _generation)
+    {
+        invalidate();
+        _config = &config;
+        _generation = config.generation;
+    }
+
+    STATS_START(start);
+    std::ostringstream key;
+    key << port << ' ' << method << ' ' << host << ' ' << uri;
+
+    long now = monotonicMs();
+    Entry* cached = _entries.find(key.str());
+    if (cached && cached->expires > now)
+    {
+        ++_stats.hits;
+        // a miss is counted by resolveRoute itself
+        STATS_PHASE(PHASE_TOTAL, start);
+        STATS_CACHED(config, cached->result);
+        return cached->result;
+    }
+    ++_stats.misses;
+
+    Entry entry;
+    entry.expires = now + _ttl;
+    entry.result = resolveRoute(config, host, port, uri, method, &_files);
+
+    if (_entries.insert(key.str(), entry))
+        ++_stats.evictions;
+    return entry.result;
+}
+
+// DO: Forget every decision and stat: call it after a config reload
+void RouteCache::invalidate() {
+    _entries.clear();
+    _files.clear();
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <list>
+#include "Router.hpp"
+
+// Small bounded LRU: key => value, the least recently used entry goes first when full
+    // entries carry their own expiry time, looked up entries are moved to the front
+template <typename Value>
+class LruMap
+{
+public:
+    typedef std::pair<std::string, Value> Entry;
+
+    LruMap(size_t capacity) : _capacity(capacity ? capacity : 1) {}
+
+    Value* find(const std::string& key) {
+        typename std::map<std::string, typename std::list<Entry>::iterator>::iterator it = _index.find(key);
+        if (it == _index.end())
+            return NULL;
+        _order.splice(_order.begin(), _order, it->second);
+        return &it->second->second;
+    }
+
+    // RETURN: true if an older entry had to be evicted
+    bool insert(const std::string& key, const Value& value) {
+        bool evicted = false;
+
+        erase(key);
+        if (_order.size() >= _capacity)
+        {
+            _index.erase(_order.back().first);
+            _order.pop_back();
+            evicted = true;
+        }
+        _order.push_front(Entry(key, value));
+        _index[key] = _order.begin();
+        return evicted;
+    }
+
+    void erase(const std::string& key) {
+        typename std::map<std::string, typename std::list<Entry>::iterator>::iterator it = _index.find(key);
+        if (it == _index.end())
+            return;
+        _order.erase(it->second);
+        _index.erase(it);
+    }
+
+    void clear() {
+        _order.clear();
+        _index.clear();
+    }
+
+    size_t size() const { return _order.size(); }
+
+private:
+    size_t _capacity;
+    std::list<Entry> _order; // most recently used first
+    std::map<std::string, typename std::list<Entry>::iterator> _index;
+};
+
+// Hit/miss counters of a cache, to size it
+struct CacheStats
+{
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+
+    CacheStats() : hits(0), misses(0), evictions(0) {}
+};
+
+// StatCache: memoizes probePath() per path for ttl_ms milliseconds
+    // not thread safe: one per worker thread
+class StatCache
+{
+public:
+    StatCache(size_t capacity = 4096, long ttl_ms = 1000);
+
+    const FileProbe& probe(const std::string& path);
+
+    void clear();
+    const CacheStats& stats() const { return _stats; }
+
+private:
+    struct Entry
+    {
+        FileProbe file;
+        long expires; // ms, monotonic clock
+    };
+
+    LruMap<Entry> _entries;
+    long _ttl;
+    CacheStats _stats;
+};
+
+// RouteCache: remembers the routing decision (result and status) per (host, port, uri, method)
+    // decisions depend on the filesystem, so they expire after the same ttl as the stats
+    // everything is dropped when the config changes (invalidate(), or routing with another Config / generation)
+    // not thread safe: one per worker thread
+class RouteCache
+{
+public:
+    RouteCache(size_t capacity = 4096, size_t stat_capacity = 4096, long ttl_ms = 1000);
+
+    RoutingResult route(const Config& config, const std::string& host,
+                        int port, const std::string& uri, const std::string& method);
+    RoutingResult resolve(const Config& config, const std::string& host,
+                        int port, const std::string& uri, const std::string& method);
+    void invalidate();
+
+    const CacheStats& stats() const { return _stats; }
+    const CacheStats& statStats() const { return _files.stats(); }
+
+private:
+    struct Entry
+    {
+        RoutingResult result;
+        long expires;
+    };
+
+    LruMap<Entry> _entries;
+    StatCache _files;
+    const Config* _config; // config the entries were computed with
+    unsigned long _generation;
+    long _ttl;
+    CacheStats _stats;
+};
+
+long monotonicMs();
@@ -0,0 +1,307 @@
+#include "RouteStats.hpp"
+
+#ifdef WEBSERV_STATS
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include "Router.hpp"
+
+// What a route ended with
+enum Outcome
+{
+    OUT_OK,
+    OUT_REDIRECT,
+    OUT_AUTOINDEX,
+    OUT_NOT_FOUND,
+    OUT_FORBIDDEN,
+    OUT_METHOD,
+    OUT_COUNT
+};
+
+static const char* g_outcomes[OUT_COUNT] = { "ok", "redirect", "autoindex", "404", "403", "405" };
+static const char* g_phases[PHASE_COUNT] = { "server", "location", "probe", "total" };
+
+// Only the owning thread writes a counter: a relaxed load + store is enough (no locked add),
+    // the atomics only make the reads of dumpRouteStats well defined
+static void bump(uint64_t* counter, uint64_t value) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+static uint64_t load(const uint64_t* counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+// Counters of many slots (servers or locations), allocated by chunks as slots are first used
+    // a chunk never moves once published, so readers need no lock
+class SlotCounters
+{
+public:
+    static const size_t CHUNK = 1024;      // slots per chunk
+    static const size_t MAX_CHUNKS = 1024; // up to 1M slots, later ones are not counted
+
+    SlotCounters() { std::memset(_chunks, 0, sizeof(_chunks)); }
+
+    void add(size_t slot, Outcome outcome) {
+        size_t c = slot / CHUNK;
+        if (c >= MAX_CHUNKS)
+            return;
+        uint64_t* chunk = _chunks[c];
+        if (!chunk)
+        {
+            chunk = new uint64_t[CHUNK * OUT_COUNT]();
+            __atomic_store_n(&_chunks[c], chunk, __ATOMIC_RELEASE);
+        }
+        bump(&chunk[(slot % CHUNK) * OUT_COUNT + outcome], 1);
+    }
+
+    // RETURN: the count, 0 for a slot never used
+    uint64_t get(size_t slot, Outcome outcome) const {
+        size_t c = slot / CHUNK;
+        if (c >= MAX_CHUNKS)
+            return 0;
+        const uint64_t* chunk = __atomic_load_n(&_chunks[c], __ATOMIC_ACQUIRE);
+        return chunk ? load(&chunk[(slot % CHUNK) * OUT_COUNT + outcome]) : 0;
+    }
+
+    void reset() {
+        for (size_t c = 0; c < MAX_CHUNKS; ++c)
+        {
+            uint64_t* chunk = __atomic_load_n(&_chunks[c], __ATOMIC_ACQUIRE);
+            for (size_t i = 0; chunk && i < CHUNK * OUT_COUNT; ++i)
+                __atomic_store_n(&chunk[i], 0, __ATOMIC_RELAXED);
+        }
+    }
+
+private:
+    uint64_t* _chunks[MAX_CHUNKS];
+};
+
+// HDR-style histogram of nanoseconds: 8 linear buckets per power of two (12.5% precision), 1ns to 2^64
+struct Histogram
+{
+    static const int SUB = 8;
+    static const int BUCKETS = (64 - 2) * SUB;
+
+    uint64_t buckets[BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+
+    static int bucket(uint64_t v) {
+        if (v < (uint64_t)SUB)
+            return v;
+        int e = 63 - __builtin_clzll(v); // 3 or more
+        return (e - 2) * SUB + ((v >> (e - 3)) & (SUB - 1));
+    }
+
+    // the highest value falling in bucket b
+    static uint64_t upper(int b) {
+        if (b < SUB)
+            return b;
+        int e = b / SUB + 2;
+        uint64_t low = (uint64_t)(SUB + b % SUB) << (e - 3);
+        return low + ((uint64_t)1 << (e - 3)) - 1;
+    }
+};
+
+// Everything one thread counts
+struct ThreadStats
+{
+    SlotCounters locations; // by frozen location number
+    SlotCounters servers;   // by server number: requests that matched no location
+    uint64_t no_server;
+    Histogram phases[PHASE_COUNT];
+    ThreadStats* next;
+
+    ThreadStats() : no_server(0), next(NULL) { std::memset(phases, 0, sizeof(phases)); }
+};
+
+// Every block ever created: they outlive their thread so its counts still add up
+static ThreadStats* g_threads = NULL;
+static __thread ThreadStats* t_stats = NULL;
+
+static ThreadStats& local() {
+    if (!t_stats)
+    {
+        ThreadStats* block = new ThreadStats();
+        block->next = __atomic_load_n(&g_threads, __ATOMIC_ACQUIRE);
+        while (!__atomic_compare_exchange_n(&g_threads, &block->next, block, true,
+                                            __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+            ;
+        t_stats = block;
+    }
+    return *t_stats;
+}
+
+uint64_t statsClock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+void recordPhase(RoutePhase phase, uint64_t nanoseconds) {
+    Histogram& h = local().phases[phase];
+    bump(&h.buckets[Histogram::bucket(nanoseconds)], 1);
+    bump(&h.count, 1);
+    bump(&h.sum, nanoseconds);
+}
+
+// DO: Count a final result against its location (or its server when no location matched)
+void recordResult(const Config& config, const RoutePlan& plan, const RoutingResult& result) {
+    ThreadStats& stats = local();
+    Outcome outcome;
+
+    switch (result.status)
+    {
+        case ROUTE_OK: outcome = result.use_autoindex ? OUT_AUTOINDEX : OUT_OK; break;
+        case ROUTE_REDIRECT: outcome = OUT_REDIRECT; break;
+        case ROUTE_NO_LOCATION:
+        case ROUTE_NOT_FOUND: outcome = OUT_NOT_FOUND; break;
+        case ROUTE_METHOD_NOT_ALLOWED: outcome = OUT_METHOD; break;
+        default: outcome = OUT_FORBIDDEN; break;
+    }
+    if (!result.server)
+        bump(&stats.no_server, 1);
+    else if (!result.location)
+        stats.servers.add(result.server - &config.servers[0], outcome);
+    else
+        stats.locations.add(plan.location, outcome);
+}
+
+// Same as recordResult for a result that comes out of a RouteCache, without its RoutePlan:
+    // the frozen location number is found back from the location pointer
+void recordCachedResult(const Config& config, const RoutingResult& result) {
+    RoutePlan plan;
+
+    if (result.server && result.location)
+    {
+        size_t server = result.server - &config.servers[0];
+        plan.location = config.frozen.servers[server].first_location + (result.location - &result.server->locations[0]);
+    }
+    recordResult(config, plan, result);
+}
+
+void resetRouteStats() {
+    for (ThreadStats* t = __atomic_load_n(&g_threads, __ATOMIC_ACQUIRE); t; t = t->next)
+    {
+        t->locations.reset();
+        t->servers.reset();
+        __atomic_store_n(&t->no_server, 0, __ATOMIC_RELAXED);
+        for (int p = 0; p < PHASE_COUNT; ++p)
+        {
+            Histogram& h = t->phases[p];
+            for (int b = 0; b < Histogram::BUCKETS; ++b)
+                __atomic_store_n(&h.buckets[b], 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&h.count, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&h.sum, 0, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Label value with '\' and '"' escaped
+static std::string label(const std::string& s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        if (s[i] == '\\' || s[i] == '"')
+            out += '\\';
+        out += s[i];
+    }
+    return out;
+}
+
+static std::string serverLabels(const Config& config, size_t server) {
+    const ServerConfig& s = config.servers[server];
+    char index[32];
+    std::sprintf(index, "%lu", (unsigned long)server);
+    return std::string("server=\"") + index + "\",name=\""
+           + label(s.server_name.empty() ? "" : s.server_name[0]) + "\"";
+}
+
+// DO: Sum every thread's counts and write them in the Prometheus text format
+    // counters with a zero value are left out: a big config stays readable
+void dumpRouteStats(const Config& config, std::string& out) {
+    ThreadStats* threads = __atomic_load_n(&g_threads, __ATOMIC_ACQUIRE);
+    char line[256];
+
+    out += "# HELP webserv_route_requests_total Routed requests by server, location and outcome\n";
+    out += "# TYPE webserv_route_requests_total counter\n";
+    uint64_t no_server = 0;
+    for (ThreadStats* t = threads; t; t = t->next)
+        no_server += load(&t->no_server);
+    if (no_server)
+    {
+        std::sprintf(line, "webserv_route_requests_total{outcome=\"400\"} %llu\n", (unsigned long long)no_server);
+        out += line;
+    }
+    for (size_t s = 0; s < config.servers.size(); ++s)
+    {
+        const ServerConfig& server = config.servers[s];
+        std::string labels = serverLabels(config, s);
+
+        for (size_t l = 0; l <= server.locations.size(); ++l)
+        {
+            // l == locations.size(): requests of the server that matched no location
+            size_t global = config.frozen.servers[s].first_location + l;
+            bool none = (l == server.locations.size());
+            for (int o = 0; o < OUT_COUNT; ++o)
+            {
+                uint64_t n = 0;
+                for (ThreadStats* t = threads; t; t = t->next)
+                    n += none ? t->servers.get(s, (Outcome)o) : t->locations.get(global, (Outcome)o);
+                if (!n)
+                    continue;
+                out += "webserv_route_requests_total{" + labels + ",location=\""
+                       + (none ? std::string() : label(server.locations[l].path)) + "\",outcome=\"" + g_outcomes[o] + "\"} ";
+                std::sprintf(line, "%llu\n", (unsigned long long)n);
+                out += line;
+            }
+        }
+    }
+
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    out += "# HELP webserv_route_phase_seconds Time spent in each routing phase\n";
+    out += "# TYPE webserv_route_phase_seconds summary\n";
+    for (int p = 0; p < PHASE_COUNT; ++p)
+    {
+        std::vector<uint64_t> buckets(Histogram::BUCKETS, 0);
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        for (ThreadStats* t = threads; t; t = t->next)
+        {
+            for (int b = 0; b < Histogram::BUCKETS; ++b)
+                buckets[b] += load(&t->phases[p].buckets[b]);
+            count += load(&t->phases[p].count);
+            sum += load(&t->phases[p].sum);
+        }
+        if (!count)
+            continue;
+
+        // totals read a moment apart from the buckets: rank against the buckets' own total
+        uint64_t total = 0;
+        for (int b = 0; b < Histogram::BUCKETS; ++b)
+            total += buckets[b];
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); ++q)
+        {
+            uint64_t rank = (uint64_t)(quantiles[q] * (total - 1)) + 1;
+            uint64_t seen = 0;
+            int b = 0;
+            while (b < Histogram::BUCKETS - 1 && (seen += buckets[b]) < rank)
+                ++b;
+            std::sprintf(line, "webserv_route_phase_seconds{phase=\"%s\",quantile=\"%g\"} %.9f\n",
+                         g_phases[p], quantiles[q], Histogram::upper(b) / 1e9);
+            out += line;
+        }
+        std::sprintf(line, "webserv_route_phase_seconds_sum{phase=\"%s\"} %.9f\n", g_phases[p], sum / 1e9);
+        out += line;
+        std::sprintf(line, "webserv_route_phase_seconds_count{phase=\"%s\"} %llu\n", g_phases[p], (unsigned long long)count);
+        out += line;
+    }
+}
+
+#else
+
+void dumpRouteStats(const Config&, std::string&) {}
+
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+struct Config;
+struct RoutingResult;
+struct RoutePlan;
+
+// Route statistics: what each server / location answers, and how long each routing phase takes
+    // only built with -DWEBSERV_STATS (make STATS=1): without it the macros below are empty
+    // every thread counts in its own block (no lock, no atomic read-modify-write),
+    // dumpRouteStats() adds the blocks up when asked
+    // counters are indexed by server / frozen location number: reset them after a reload that
+    // changes the layout of the config
+
+enum RoutePhase
+{
+    PHASE_SERVER,   // findServer
+    PHASE_LOCATION, // location walk in the frozen trie
+    PHASE_PROBE,    // stat of the target and of the index
+    PHASE_TOTAL,    // the whole resolveRoute, or the lookup of a RouteCache hit
+    PHASE_COUNT
+};
+
+#ifdef WEBSERV_STATS
+
+uint64_t statsClock();
+void recordPhase(RoutePhase phase, uint64_t nanoseconds);
+void recordResult(const Config& config, const RoutePlan& plan, const RoutingResult& result);
+void recordCachedResult(const Config& config, const RoutingResult& result);
+void resetRouteStats();
+
+# define STATS_START(name) uint64_t name = statsClock()
+# define STATS_PHASE(phase, start) recordPhase(phase, statsClock() - (start))
+# define STATS_RESULT(config, plan, result) recordResult(config, plan, result)
+# define STATS_CACHED(config, result) recordCachedResult(config, result)
+
+#else
+
+# define STATS_START(name)
+# define STATS_PHASE(phase, start)
+# define STATS_RESULT(config, plan, result)
+# define STATS_CACHED(config, result)
+
+#endif
+
+// Prometheus text format of every count so far (empty when compiled out)
+void dumpRouteStats(const Config& config, std::string& out);
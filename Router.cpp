@@ -1,83 +1,56 @@
 #include "Router.hpp"
+#include "RouteCache.hpp"
+#include "RouteStats.hpp"
+#include "OpenFileCache.hpp"
+#include <algorithm>
 #include "sys/stat.h"
 #include "unistd.h"
 
 
 // DO: Match a server block based on host and port
-// RETURN: the first server block that matches the port, or the first server block matches the host if no port match is found
+// RETURN: the first server block that matches the port and the host, or the first server block on that port if no host matches
+    // one port lookup + one probe in the port's host index (see compileRoutes)
 const ServerConfig& matchServer(const Config& config, const std::string& host, int port) {
-    const ServerConfig* fallback = NULL;
+    const ServerConfig* server = findServer(config, host, port);
 
-    for (size_t i = 0; i < config.servers.size(); ++i)
-    {
-        const ServerConfig& server = config.servers[i];
+    if (!server)
+        throw std::runtime_error("No server block found for that port");
+    return *server;
+}
 
-        // Check all listen blocks for port match
-        for (size_t j = 0; j < server.listens.size(); ++j)
-        {
-            if (server.listens[j].listen_port == port)
-            {
-                // Save first match as fallback
-                if (!fallback)
-                    fallback = &server;
-
-                // Now check server_name match
-                for (size_t k = 0; k < server.server_name.size(); ++k)
-                {
-                    if (server.server_name[k] == host)
-                        return server; // Exact match
-                }
-            }
-        }
-    }
+// Same as matchServer without throwing
+// RETURN: NULL if nothing listens on that port
+const ServerConfig* findServer(const Config& config, const std::string& host, int port) {
+    const PortRoute* route = findPort(config.routes, port);
 
-    if (fallback)
-        return *fallback;
-    else
-        throw std::runtime_error("No server block found for that port");
+    if (!route)
+        return NULL;
+
+    size_t index = findServerByName(*route, host);
+    if (index == std::string::npos)
+        index = route->default_server;
+
+    return &config.servers[index];
 }
 
 
 // DO: This function matches the longest location path for a given URI in a server block.
 // RETURN: the location block that matches the URI
+    // the lookup is one walk down the server's location trie (see compileLocations):
+    /*
+        the same three cases as before:
+        1. path is exactly the same as uri (e.g. /images == /images)
+        2. path is a prefix of uri and uri continues with a slash (e.g. /images == /images/...)
+            but not when uri continues with another character (e.g. /images != /imageshack)
+        3. or the path is a root location (e.g. / == /images)
+    */
 const LocationConfig& matchLocation(const ServerConfig& server, const std::string& uri) {
-    
-    const LocationConfig *match = NULL;
-    size_t longest = 0;
+    size_t index = findLocation(server, uri);
 
-    for (size_t i = 0; i < server.locations.size(); ++i)
-    {
-        const LocationConfig& loc = server.locations[i];
-        const std::string& path = loc.path;
-
-        if (uri.compare(0, path.size(), path) == 0) //path.size() is the second argument, and its for str1 not str2 as well as first argument
-        {
-            // the root location always matches everything -> for the path
-            // & checking for full match -> for both
-            // Check valid path boundary (e.g. /images should not match /imageshack) if path is a part of uri we have to check if it end with /
-                // with a slash else it's a full match
-            /*
-                there is three cases:
-                1. path is exactly the same as uri (e.g. /images == /images)
-                2. path is a prefix of uri and uri continues with a slash (e.g. /images == /images/...)
-                    path is a prefix of uri and uri continues with another character or less character (e.g. /images == /imageshack or /image)
-                3. or the path is a root location (e.g. / == /images)
-            */
-            if (path == "/" || uri.size() == path.size() || uri[path.size()] == '/')
-            {
-                if (path.size() > longest)
-                {
-                    match = &loc;
-                    longest = path.size();
-                }
-            }
-        }
-    }
-
-    if (!match)
+    if (index == std::string::npos)
         throw std::runtime_error("No matching location for URI: " + uri);
 
-    return *match;
+    return server.locations[index];
 }
 
 
@@ -87,16 +60,18 @@ std::string finalPath(const LocationConfig& location, const std::string& uri) {
     const std::string& root = location.root;
     const std::string& locPath = location.path;
 
-    // Step 1: remove the location path from the URI
-        // substr(index to start from, length of the substring)
-    std::string remain = uri.substr(locPath.length());
+    // Step 1: skip the location path in the URI (no substring: the rest is appended in place)
+    size_t skip = locPath.length();
 
     // Step 2: avoid double slashes
-    if (root[root.size() - 1] == '/' && !remain.empty() && remain[0] == '/')
-        remain = remain.substr(1);
+    if (!root.empty() && root[root.size() - 1] == '/' && skip < uri.size() && uri[skip] == '/')
+        ++skip;
 
-    // Step 3: combine root + remain
-    return root + remain;
+    // Step 3: combine root + remain, in one allocation
+    std::string path;
+    path.reserve(root.size() + uri.size() - skip);
+    path.append(root).append(uri, skip, std::string::npos);
+    return path;
 }
 
 
@@ -122,85 +97,477 @@ bool fileExists(const std::string& path) {
     return (stat(path.c_str(), &s) == 0);
 }
 
+// RETURN: 1 or 0 when the permission bits alone give the answer of access(path, R_OK), -1 when they don't
+    // the uid is read on every call (cheap, and right after a setuid privilege drop)
+    // root reads anything; the owner bits are exact, ACLs included (the ACL owner entry is those bits);
+    // for anyone else an ACL entry can grant or deny what the group and other bits say, unless both
+    // deny: the group bits are then the ACL mask, which no named entry gets past
+int readableByMode(uid_t owner, mode_t mode) {
+    uid_t uid = getuid();
+
+    if (uid == 0)
+        return 1;
+    if (owner == uid)
+        return (mode & S_IRUSR) ? 1 : 0;
+    if (!(mode & (S_IRGRP | S_IROTH)))
+        return 0;
+    return -1;
+}
+
+// Same answer as access(path, R_OK): from the permission bits when they decide it, else access() itself
+bool canRead(const char* path, uid_t owner, mode_t mode) {
+    int readable = readableByMode(owner, mode);
+    if (readable >= 0)
+        return readable;
+    return access(path, R_OK) == 0;
+}
+
+// DO: Everything routing needs to know about a path, with one stat()
+// RETURN: a FileProbe (exists = false if stat failed)
+FileProbe probePath(const std::string& path) {
+    return probePath(path.c_str());
+}
+
+FileProbe probePath(const char* path) {
+    FileProbe probe;
+    struct stat s;
+
+    if (stat(path, &s) != 0)
+        return probe;
+    probe.exists = true;
+    probe.directory = S_ISDIR(s.st_mode);
+    probe.readable = canRead(path, s.st_uid, s.st_mode);
+    probe.size = s.st_size;
+    probe.mtime = s.st_mtime;
+    return probe;
+}
+
+// Answered by the stat cache when the caller has one
+static FileProbe probe(const std::string& path, StatCache* stats) {
+    return stats ? stats->probe(path) : probePath(path);
+}
+
 // DO: This function routes a request based on the configuration, host, port, and URI.
 // RETURN: a RoutingResult containing the matched server, location, file path, and redirection
+    // throws with the reason when the request can't be served (see resolveRoute for the non-throwing version)
+RoutingResult routingResult(const Config& config, const std::string& host,
+                        int port, const std::string& uri, const std::string& method)
+{
+    return routingResult(config, host, port, uri, method, NULL);
+}
+
+// stats: filesystem checks go through this cache (NULL: straight syscalls)
+RoutingResult routingResult(const Config& config, const std::string& host,
+                        int port, const std::string& uri, const std::string& method, StatCache* stats)
+{
+    RoutingResult result = resolveRoute(config, host, port, uri, method, stats);
+
+    throwRouteError(result, uri, method);
+    return result;
+}
+
+// DO: Throw the error matching a failed RoutingResult (nothing for ROUTE_OK and ROUTE_REDIRECT)
+    // the messages are the ones routingResult always threw
+    // the path that failed is rebuilt from the location when resolveRoute did not keep it
+void throwRouteError(const RoutingResult& result, const std::string& uri, const std::string& method) {
+    std::string path = result.file_path;
+
+    if (path.empty() && result.location)
+    {
+        path = finalPath(*result.location, uri);
+        if (result.status == ROUTE_INDEX_FORBIDDEN)
+            path += "/" + result.location->index;
+    }
+    switch (result.status)
+    {
+        case ROUTE_OK:
+        case ROUTE_REDIRECT:
+            return;
+        case ROUTE_NO_SERVER:
+            throw std::runtime_error("No server block found for that port");
+        case ROUTE_NO_LOCATION:
+            throw std::runtime_error("No matching location for URI: " + uri);
+        case ROUTE_NOT_FOUND:
+            throw std::runtime_error("File does not exist: " + path);
+        case ROUTE_FORBIDDEN:
+            throw std::runtime_error("Cannot access file: " + path);
+        case ROUTE_INDEX_FORBIDDEN:
+            throw std::runtime_error("Cannot access index file: " + path);
+        case ROUTE_NO_INDEX:
+            throw std::runtime_error("No index file found and autoindex is off");
+        case ROUTE_METHOD_NOT_ALLOWED:
+            throw std::runtime_error("Method not allowed for this location: " + method);
+    }
+}
+
+// HTTP status to answer with for a RouteStatus
+int routeStatusCode(RouteStatus status) {
+    switch (status)
+    {
+        case ROUTE_OK: return 200;
+        case ROUTE_REDIRECT: return 302;
+        case ROUTE_NO_SERVER: return 400;
+        case ROUTE_NO_LOCATION: return 404;
+        case ROUTE_NOT_FOUND: return 404;
+        case ROUTE_FORBIDDEN: return 403;
+        case ROUTE_INDEX_FORBIDDEN: return 403;
+        case ROUTE_NO_INDEX: return 403;
+        case ROUTE_METHOD_NOT_ALLOWED: return 405;
+    }
+    return 500;
+}
+
+// DO: The complete error response to send for a code, built by freezeConfig, configured pages read by loadErrorPages
+// RETURN: the bytes in the config (no I/O, no allocation); server NULL: the built-in pages
+ConfigBytes errorResponse(const Config& config, const ServerConfig* server, int code) {
+    size_t index = server ? server - &config.servers[0] : config.servers.size();
+    const FrozenString& response = frozenErrorResponse(config.frozen, index, code);
+    ConfigBytes bytes;
+
+    bytes.data = config.frozen.data(response);
+    bytes.length = response.length;
+    return bytes;
+}
+
+// DO: Route a request without throwing: the outcome is in result.status
+// RETURN: a RoutingResult; file_path is only sure to be set for ROUTE_OK (throwRouteError rebuilds it)
 // 📌 Summary :
     // we have many cases like:
     // 1. if the location has a redirection, we return the redirection URL
     // 2. if the location is a directory and has an index file, we return the index file path after checks
     // 3. if the location is a directory and has autoindex enabled, we return the directory path and set use_autoindex to true
     // 4. if the location is a file, we check if it exists and is accessible, then return the file path
-RoutingResult routingResult(const Config& config, const std::string& host,
-                        int port, const std::string& uri, const std::string& method)
+    // the method is checked last, except for an index file found in a directory
+RoutingResult resolveRoute(const Config& config, const std::string& host,
+                        int port, const std::string& uri, const std::string& method, StatCache* stats)
+{
+    return resolveRoute(config, host, port, uri, parseMethod(method), stats);
+}
+
+// method: already classified by the request parser
+RoutingResult resolveRoute(const Config& config, const std::string& host,
+                        int port, const std::string& uri, HttpMethod method, StatCache* stats)
+{
+    STATS_START(start);
+    RoutingResult result;
+    RoutePlan plan;
+    char path[RoutePlan::BUFFER_SIZE];
+
+    // the stat cache is keyed by strings: the buffer only helps straight syscalls
+    if (!stats)
+    {
+        plan.buffer = path;
+        plan.buffer_size = sizeof(path);
+    }
+    RouteStep step = routeMatch(config, host, port, uri, method, result, plan);
+
+    STATS_START(probing);
+    if (step == STEP_PROBE_FILE)
+        step = routeFile(config, plan, result, plan.buffer ? probePath(plan.buffer) : probe(result.file_path, stats));
+    if (step == STEP_PROBE_INDEX)
+        routeIndex(config, plan, result, plan.buffer ? probePath(plan.buffer) : probe(plan.index_path, stats));
+    STATS_PHASE(PHASE_PROBE, probing);
+    STATS_PHASE(PHASE_TOTAL, start);
+    STATS_RESULT(config, plan, result);
+    return result;
+}
+
+// DO: Step 2 of the OpenFileCache resolveRoute: open (or stat) the target and the index
+static void routeOpen(const Config& config, RoutePlan& plan, RoutingResult& result, OpenFileCache& files) {
+    long valid = config.frozen.loc_open_valid[plan.location];
+    long inactive = config.frozen.loc_open_inactive[plan.location];
+    RouteStep step;
+
+    if (valid < 0)
+    {
+        step = routeFile(config, plan, result, probePath(result.file_path));
+        if (step == STEP_PROBE_INDEX)
+            routeIndex(config, plan, result, probePath(plan.index_path));
+        return;
+    }
+
+    OpenFile* file = files.acquire(result.file_path, valid, inactive);
+    step = routeFile(config, plan, result, file->probe);
+    if (step == STEP_PROBE_INDEX)
+    {
+        files.release(file);
+        file = files.acquire(plan.index_path, valid, inactive);
+        routeIndex(config, plan, result, file->probe);
+    }
+    if (result.status == ROUTE_OK && !result.use_autoindex && file->fd >= 0)
+        result.open_file = file;
+    else
+        files.release(file);
+}
+
+// files: the target is opened (or found open) instead of stat-ed; a servable file comes back in
+    // result.open_file with its fd, to give back with files.release() once sent
+    // locations of servers without open_file_cache are routed as usual
+RoutingResult resolveRoute(const Config& config, const std::string& host,
+                        int port, const std::string& uri, HttpMethod method, OpenFileCache& files)
 {
-    const ServerConfig& server = matchServer(config, host, port);
-    const LocationConfig& location = matchLocation(server, uri);
-    
+    STATS_START(start);
     RoutingResult result;
-    result.server = &server;
-    result.location = &location;
+    RoutePlan plan;
+    RouteStep step = routeMatch(config, host, port, uri, method, result, plan);
+
+    STATS_START(probing);
+    if (step != STEP_DONE)
+        routeOpen(config, plan, result, files);
+    STATS_PHASE(PHASE_PROBE, probing);
+    STATS_PHASE(PHASE_TOTAL, start);
+    STATS_RESULT(config, plan, result);
+    return result;
+}
+
+// The last check of every route: the method (not done for an index file found in a directory)
+static RouteStep checkMethod(const Config& config, const RoutePlan& plan, RoutingResult& result) {
+    if (!(config.frozen.loc_methods[plan.location] & plan.method))
+        result.status = ROUTE_METHOD_NOT_ALLOWED;
+    return STEP_DONE;
+}
+
+// DO: Step 1 of resolveRoute: server, location and file path, no filesystem access
+// RETURN: STEP_PROBE_FILE when result.file_path has to be probed, else STEP_DONE
+RouteStep routeMatch(const Config& config, const std::string& host, int port,
+                        const std::string& uri, HttpMethod method, RoutingResult& result, RoutePlan& plan)
+{
     result.server_count = config.servers.size();
+    plan.method = method;
 
-    if (!location.redirection.empty())
+    const ServerConfig* server = plan.server;
+    if (!server)
     {
+        STATS_START(start);
+        server = findServer(config, host, port);
+        STATS_PHASE(PHASE_SERVER, start);
+    }
+    if (!server)
+    {
+        result.status = ROUTE_NO_SERVER;
+        return STEP_DONE;
+    }
+    result.server = server;
+
+    // from here everything is read from the frozen form (see freezeConfig)
+    const FrozenConfig& frozen = config.frozen;
+    size_t server_index = server - &config.servers[0];
+    STATS_START(walk);
+    uint32_t loc = frozenLocation(frozen, server_index, uri, plan.cursor);
+    STATS_PHASE(PHASE_LOCATION, walk);
+    if (loc == FrozenConfig::NO_LOCATION)
+    {
+        result.status = ROUTE_NO_LOCATION;
+        return STEP_DONE;
+    }
+    result.location = &server->locations[loc];
+    plan.location = loc + frozen.servers[server_index].first_location;
+
+    if (frozen.loc_flags[plan.location] & LOC_REDIRECT)
+    {
+        result.status = ROUTE_REDIRECT;
         result.is_redirect = true;
-        result.redirect_url = location.redirection;
+        // no copy: both point into the frozen arena, the response was built by freezeConfig
+        const FrozenString& url = frozen.loc_redirection[plan.location];
+        const FrozenString& response = frozen.loc_redirect_response[plan.location];
+        result.redirect_url.data = frozen.data(url);
+        result.redirect_url.length = url.length;
+        result.response.data = frozen.data(response);
+        result.response.length = response.length;
         result.use_autoindex = false;
+        return checkMethod(config, plan, result);
     }
-    else
+    result.is_redirect = false;
+
+    // in the caller's buffer when it fits with the index suffix after it: no allocation while probing
+    if (plan.buffer)
     {
-        result.file_path = finalPath(location, uri);
-        result.is_redirect = false;
-        if (isDirectory(result.file_path))
+        size_t room = plan.buffer_size - frozen.loc_join[plan.location].index_suffix.length;
+        if (room <= plan.buffer_size)
         {
-            if (!location.index.empty())
-            {
-                std::string index_path = result.file_path + "/" + location.index;
+            plan.path_length = frozenPath(frozen, plan.location, uri, plan.buffer, room);
+            if (plan.path_length < room)
+                return STEP_PROBE_FILE;
+        }
+        plan.buffer = NULL;
+    }
+    frozenPath(frozen, plan.location, uri, result.file_path);
+    return STEP_PROBE_FILE;
+}
 
-                if (fileExists(index_path))
-                {
-                    if (access(index_path.c_str(), R_OK) != 0)
-                        throw std::runtime_error("Cannot access index file: " + index_path);
+// The route is final: the path built in the plan's buffer becomes result.file_path, only when it is
+    // served; a 404 or 403 costs no allocation
+static RouteStep keepPath(const RoutePlan& plan, RoutingResult& result, size_t length) {
+    if (plan.buffer && result.status == ROUTE_OK)
+        result.file_path.assign(plan.buffer, length);
+    return STEP_DONE;
+}
 
-                    result.use_autoindex = false;
-                    result.file_path = index_path;
-                    return result; // We're done
-                }
-            }
+// DO: Step 2: what the probe of result.file_path says
+// RETURN: STEP_PROBE_INDEX when plan.index_path has to be probed, else STEP_DONE
+RouteStep routeFile(const Config& config, RoutePlan& plan, RoutingResult& result, const FileProbe& file)
+{
+    const FrozenConfig& frozen = config.frozen;
+    unsigned char flags = frozen.loc_flags[plan.location];
 
-            // Either index was empty or the index file was missing
-            if (location.autoindex)
-            {
-                result.use_autoindex = true;
-            }
-            else
+    result.file = file;
+    if (file.directory)
+    {
+        if (flags & LOC_INDEX)
+        {
+            const FrozenString& suffix = frozen.loc_join[plan.location].index_suffix;
+
+            // after the file path in the caller's buffer (routeMatch left room for it), else in plan.index_path
+            if (plan.buffer)
             {
-                throw std::runtime_error("No index file found and autoindex is off");
+                frozenIndexPath(frozen, plan.location, plan.buffer, plan.path_length, plan.buffer_size);
+                return STEP_PROBE_INDEX;
             }
+            plan.index_path.reserve(result.file_path.size() + suffix.length);
+            plan.index_path.assign(result.file_path).append(frozen.data(suffix), suffix.length);
+            return STEP_PROBE_INDEX;
         }
-        // if the file does not exist here that means that's ur prblm you provided the wrong path
+        return routeIndex(config, plan, result, FileProbe());
+    }
+
+    // if the file does not exist here that means that's ur prblm you provided the wrong path
+    result.use_autoindex = false;
+    result.is_directory = false; // It's a file, not a directory
+
+    if (!file.exists)
+        result.status = ROUTE_NOT_FOUND;
+    else if (!file.readable)
+        result.status = ROUTE_FORBIDDEN;
+    else
+        checkMethod(config, plan, result);
+    return keepPath(plan, result, plan.path_length);
+}
+
+// DO: Step 3, for a directory: what the probe of plan.index_path says (an empty probe if there is no index)
+// RETURN: STEP_DONE
+RouteStep routeIndex(const Config& config, RoutePlan& plan, RoutingResult& result, const FileProbe& index)
+{
+    if (index.exists)
+    {
+        // room for the suffix was reserved by frozenPath: no reallocation
+        const FrozenString& suffix = config.frozen.loc_join[plan.location].index_suffix;
+        if (!plan.buffer)
+            result.file_path.append(config.frozen.data(suffix), suffix.length);
+        result.file = index;
+        if (!index.readable)
+            result.status = ROUTE_INDEX_FORBIDDEN;
         else
-        {
             result.use_autoindex = false;
-            result.is_directory = false; // It's a file, not a directory
+        return keepPath(plan, result, plan.path_length + suffix.length); // We're done
+    }
+
+    // Either index was empty or the index file was missing
+    if (config.frozen.loc_flags[plan.location] & LOC_AUTOINDEX)
+    {
+        result.use_autoindex = true;
+        result.is_directory = true;
+    }
+    else
+        result.status = ROUTE_NO_INDEX;
+    if (result.status == ROUTE_OK)
+        checkMethod(config, plan, result);
+    return keepPath(plan, result, plan.path_length);
+}
+
+// Orders a batch by port, host then uri: same server in a row, uris sharing prefixes side by side
+struct BatchOrder
+{
+    const RouteRequest* requests;
+
+    bool operator()(size_t a, size_t b) const {
+        const RouteRequest& x = requests[a];
+        const RouteRequest& y = requests[b];
+        if (x.port != y.port)
+            return x.port < y.port;
+        int c = x.host.compare(y.host);
+        if (c)
+            return c < 0;
+        return x.uri < y.uri;
+    }
+};
+
+// Probes every distinct path of a batch step once, in path order
+static void probeAll(std::map<std::string, FileProbe>& paths, StatCache* stats) {
+    for (std::map<std::string, FileProbe>::iterator it = paths.begin(); it != paths.end(); ++it)
+        it->second = probe(it->first, stats);
+}
+
+// DO: Route count requests at once, results[i] is the answer to requests[i]
+    // 1. requests are sorted: one server lookup per (port, host) group, and the location walk of a uri
+    //    resumes the walk of the previous one where they share segments
+    // 2. the distinct target paths are probed together, then the distinct index paths
+    // every result is the one resolveRoute would give for that request
+void routeBatch(const Config& config, const RouteRequest* requests, size_t count,
+                        RoutingResult* results, StatCache* stats)
+{
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; ++i)
+        order[i] = i;
+    BatchOrder less;
+    less.requests = requests;
+    std::sort(order.begin(), order.end(), less);
+
+    std::vector<RoutePlan> plans(count);
+    std::vector<RouteStep> steps(count);
+    std::map<std::string, FileProbe> files;
+    TrieCursor cursor;
+    const RouteRequest* previous = NULL;
+    const ServerConfig* server = NULL;
+
+    for (size_t k = 0; k < count; ++k)
+    {
+        size_t i = order[k];
+        const RouteRequest& request = requests[i];
+
+        if (!previous || previous->port != request.port || previous->host != request.host)
+            server = findServer(config, request.host, request.port);
+        previous = &request;
 
-            if (!fileExists(result.file_path))
-                throw std::runtime_error("File does not exist: " + result.file_path);
-            if (access(result.file_path.c_str(), R_OK) != 0)
-                throw std::runtime_error("Cannot access file: " + result.file_path);
+        results[i] = RoutingResult();
+        plans[i].server = server;
+        plans[i].cursor = &cursor;
+        if (!server)
+        {
+            results[i].server_count = config.servers.size();
+            results[i].status = ROUTE_NO_SERVER;
+            steps[i] = STEP_DONE;
+            continue;
         }
+        steps[i] = routeMatch(config, request.host, request.port, request.uri, request.method, results[i], plans[i]);
+        if (steps[i] == STEP_PROBE_FILE)
+            files.insert(std::make_pair(results[i].file_path, FileProbe()));
     }
+    probeAll(files, stats);
 
-    if (!isMethodAllowed(location, method))
-        throw std::runtime_error("Method not allowed for this location: " + method);
+    std::map<std::string, FileProbe> indexes;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (steps[i] != STEP_PROBE_FILE)
+            continue;
+        steps[i] = routeFile(config, plans[i], results[i], files[results[i].file_path]);
+        if (steps[i] == STEP_PROBE_INDEX)
+            indexes.insert(std::make_pair(plans[i].index_path, FileProbe()));
+    }
+    probeAll(indexes, stats);
 
-    return result;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (steps[i] == STEP_PROBE_INDEX)
+            routeIndex(config, plans[i], results[i], indexes[plans[i].index_path]);
+        STATS_RESULT(config, plans[i], results[i]);
+    }
 }
 
 bool isMethodAllowed(const LocationConfig& location, const std::string& method) {
-    for (size_t i = 0; i < location.methods.size(); ++i){
-        if (location.methods[i] == method)
-            return true;
-    }
-    return false;
+    return isMethodAllowed(location, parseMethod(method));
+}
+
+// one AND against the location's mask (METHOD_UNKNOWN is never allowed)
+bool isMethodAllowed(const LocationConfig& location, HttpMethod method) {
+    return (location.methods & method) != 0;
 }
\ No newline at end of file
@@ -1,21 +1,134 @@
+#pragma once
+
+#include <sys/types.h>
+#include <climits>
 #include "Parser.hpp"
 
+class StatCache;
+class OpenFileCache;
+struct OpenFile;
+
+// Outcome of routing a request, for the non-throwing API
+enum RouteStatus
+{
+    ROUTE_OK,                   // serve file_path (or the autoindex of it)
+    ROUTE_REDIRECT,             // redirect to redirect_url
+    ROUTE_NO_SERVER,            // nothing listens on that port
+    ROUTE_NO_LOCATION,          // no location matches the uri
+    ROUTE_NOT_FOUND,            // file_path does not exist
+    ROUTE_FORBIDDEN,            // file_path can't be read
+    ROUTE_INDEX_FORBIDDEN,      // the index file (file_path) can't be read
+    ROUTE_NO_INDEX,             // directory without index and autoindex off
+    ROUTE_METHOD_NOT_ALLOWED
+};
+
+// What one stat() tells about a path: enough to route and to serve it without another stat()
+struct FileProbe
+{
+    bool exists;
+    bool directory;
+    bool readable;  // same as access(path, R_OK) == 0
+    off_t size;
+    time_t mtime;
+
+    FileProbe() : exists(false), directory(false), readable(false), size(0), mtime(0) {}
+};
+
+// Bytes that live in the Config (its frozen arena): valid as long as that Config is
+struct ConfigBytes
+{
+    const char* data;
+    size_t length;
+
+    ConfigBytes() : data(""), length(0) {}
+    std::string str() const { return std::string(data, length); }
+};
+
 struct RoutingResult
 {
+    RouteStatus status;
     const ServerConfig* server;
     size_t server_count;
     const LocationConfig* location;
     std::string file_path;
     bool is_redirect;
-    std::string redirect_url;
+    ConfigBytes redirect_url;
+    ConfigBytes response; // redirections: the complete 302 response, ready for one send()
     bool is_directory; // true if the final path is a directory
     bool use_autoindex; // true if autoindex is enabled for the location
+    FileProbe file;     // metadata of file_path (not set for redirections)
+    OpenFile* open_file; // routed with an OpenFileCache: file_path opened for sendfile(), to release()
+
+    RoutingResult()
+        : status(ROUTE_OK), server(NULL), server_count(0), location(NULL),
+          is_redirect(false), is_directory(false), use_autoindex(false), open_file(NULL) {}
 };
 
 
+const ServerConfig* findServer(const Config& config, const std::string& host, int port);
 const ServerConfig& matchServer(const Config& config, const std::string& host, int port);
 const LocationConfig& matchLocation(const ServerConfig& server, const std::string& uri);
 std::string finalPath(const LocationConfig& location, const std::string& uri);
 RoutingResult routingResult(const Config& config, const std::string& host,
                         int port, const std::string& uri, const std::string& method);
+RoutingResult routingResult(const Config& config, const std::string& host,
+                        int port, const std::string& uri, const std::string& method, StatCache* stats);
+RoutingResult resolveRoute(const Config& config, const std::string& host,
+                        int port, const std::string& uri, const std::string& method, StatCache* stats = NULL);
+RoutingResult resolveRoute(const Config& config, const std::string& host,
+                        int port, const std::string& uri, HttpMethod method, StatCache* stats = NULL);
+RoutingResult resolveRoute(const Config& config, const std::string& host,
+                        int port, const std::string& uri, HttpMethod method, OpenFileCache& files);
+void throwRouteError(const RoutingResult& result, const std::string& uri, const std::string& method);
+int routeStatusCode(RouteStatus status);
+ConfigBytes errorResponse(const Config& config, const ServerConfig* server, int code);
+FileProbe probePath(const std::string& path);
+FileProbe probePath(const char* path);
+int readableByMode(uid_t owner, mode_t mode);
+bool canRead(const char* path, uid_t owner, mode_t mode);
+
+// resolveRoute in steps, for callers that probe the filesystem themselves (batches, async)
+enum RouteStep
+{
+    STEP_DONE,          // result is final
+    STEP_PROBE_FILE,    // probe plan.buffer (or result.file_path if NULL) then call routeFile
+    STEP_PROBE_INDEX    // probe plan.buffer (or plan.index_path if NULL) then call routeIndex
+};
+
+// State kept between the steps of one request
+struct RoutePlan
+{
+    static const size_t BUFFER_SIZE = PATH_MAX; // enough for buffer: longer paths fall back to the strings
+
+    const ServerConfig* server; // optional: already matched by the caller
+    uint32_t location;          // global location index in config.frozen
+    HttpMethod method;
+    std::string index_path;     // index to probe, when it is not in buffer
+    TrieCursor* cursor;         // optional: resume the location walk of the previous uri
+    char* buffer;               // optional: the file path, then the index path, are built here instead of in
+                                // result.file_path, which gets the final path once (NULL again if it did not fit)
+    size_t buffer_size;
+    size_t path_length;         // of the file path in buffer
+
+    RoutePlan() : server(NULL), location(0), method(METHOD_UNKNOWN), cursor(NULL), buffer(NULL), buffer_size(0),
+                  path_length(0) {}
+};
+
+RouteStep routeMatch(const Config& config, const std::string& host, int port,
+                        const std::string& uri, HttpMethod method, RoutingResult& result, RoutePlan& plan);
+RouteStep routeFile(const Config& config, RoutePlan& plan, RoutingResult& result, const FileProbe& file);
+RouteStep routeIndex(const Config& config, RoutePlan& plan, RoutingResult& result, const FileProbe& index);
+
+// One request of a batch
+struct RouteRequest
+{
+    std::string host;
+    int port;
+    std::string uri;
+    HttpMethod method;
+};
+
+void routeBatch(const Config& config, const RouteRequest* requests, size_t count,
+                        RoutingResult* results, StatCache* stats = NULL);
 bool isMethodAllowed(const LocationConfig& location, const std::string& method);
+bool isMethodAllowed(const LocationConfig& location, HttpMethod method);
@@ -1,22 +1,57 @@
 #include "Tokenizer.hpp"
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-bool is_keyword(const std::string& word)
+bool is_keyword(const char* word, size_t length)
 {
-    static const std::string keywords[] = {
-        "server", "listen", "location", "root", "methods",
-        "index", "server_name", "autoindex", "error_page",
-        "upload_dir", "cgi_extension", "redirection", "max_body_size"
-    };
-
-    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); ++i)
-        if (keywords[i] == word)
-            return true;
+    initDirectives();
+    return lookupDirective(word, length) != DIR_NONE;
+}
 
-    return false;
+bool is_keyword(const std::string& word)
+{
+    return is_keyword(word.data(), word.size());
 }
 
-Tokenizer::Tokenizer(const std::string& filePath)
+Tokenizer::Tokenizer(const std::string& filePath, bool mapFile)
+    : _data(NULL), _size(0), _mapping(NULL), _mappingSize(0)
 {
+    initDirectives();
+    if (mapFile)
+    {
+        int fd = open(filePath.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Failed to open the file");
+
+        struct stat s;
+        if (fstat(fd, &s) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to stat the file");
+        }
+        // an empty file can't be mapped, it just tokenizes to END_OF_FILE
+        if (s.st_size > 0)
+        {
+            void* map = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED)
+            {
+                close(fd);
+                throw std::runtime_error("Failed to map the file");
+            }
+            _mapping = map;
+            _mappingSize = s.st_size;
+            _data = static_cast<const char*>(map);
+            _size = _mappingSize;
+        }
+        close(fd); // the mapping stays valid after close
+        if (!_data)
+            _data = _content.c_str();
+        return;
+    }
+
     std::ifstream file(filePath.c_str());
     if (!file)
         throw std::runtime_error("Failed to open the file");
@@ -28,89 +63,172 @@ Tokenizer::Tokenizer(const std::string& filePath)
         stream << line << '\n'; //<< overloaded in stream class
                                 //std::cout << "Hello" << '\n';
     _content = stream.str(); //Give me all the text I’ve added so far, as one full string.
+    _data = _content.c_str();
+    _size = _content.size();
+}
+
+Tokenizer::~Tokenizer()
+{
+    if (_mapping)
+        munmap(_mapping, _mappingSize);
+}
+
+// DO: Scan the next token starting at pos, before end (pos is moved past it)
+// RETURN: the token length, its type, first char and directive through type/start/directive
+    // a word ends on a space or on one of { } ; = which is then its own token
+    // words are classified here, once, with the directive perfect hash
+size_t Tokenizer::next(size_t& pos, size_t end, TokenType& type, size_t& start, Directive& directive) const
+{
+    directive = DIR_NONE;
+    while (pos < end && std::isspace(static_cast<unsigned char>(_data[pos])))
+        ++pos;
+
+    start = pos;
+    if (pos >= end)
+    {
+        type = END_OF_FILE;
+        return 0;
+    }
+
+    switch (_data[pos])
+    {
+        case '{': type = BRACE_OPEN; ++pos; return 1;
+        case '}': type = BRACE_CLOSE; ++pos; return 1;
+        case ';': type = SEMICOLON; ++pos; return 1;
+        case '=': type = EQUAL; ++pos; return 1;
+        default: break;
+    }
+
+    while (pos < end)
+    {
+        char c = _data[pos];
+        if (std::isspace(static_cast<unsigned char>(c)) || c == '{' || c == '}' || c == ';' || c == '=')
+            break;
+        ++pos;
+    }
+    directive = lookupDirective(_data + start, pos - start);
+    type = directive != DIR_NONE ? KEYWORD : VALUE;
+    return pos - start;
+}
+
+// DO: Read the token at pos without copying it (pos is moved past it); END_OF_FILE from end on
+    // the view points into data(): nothing is allocated, whether the file was read or mapped
+TokenView Tokenizer::view(size_t& pos, size_t end) const
+{
+    size_t start;
+    TokenType type;
+    Directive directive;
+    size_t length = next(pos, end < _size ? end : _size, type, start, directive);
+    return TokenView(type, start, length, directive);
 }
 
 std::vector<Token> Tokenizer::tokenize()
 {
     std::vector<Token> tokens;
-    std::string word;
-    char c;
+    tokenize(tokens);
+    return tokens;
+}
 
-    for (size_t i = 0; i < _content.length(); ++i)
+// Fills tokens in place (e.g. a parser's own vector) instead of returning a copy
+void Tokenizer::tokenize(std::vector<Token>& tokens)
+{
+    tokens.clear();
+    size_t pos = 0;
+    size_t start;
+    TokenType type;
+    Directive directive;
+
+    while (true)
     {
-        c = _content[i];
+        size_t length = next(pos, _size, type, start, directive);
+        tokens.push_back(Token(type, std::string(_data + start, length), directive));
+        if (type == END_OF_FILE)
+            break;
+    }
+}
 
-        if (std::isspace(c))
-        {
-            if (!word.empty())
-            {
-                if (is_keyword(word))
-                    tokens.push_back(Token(KEYWORD, word));
-                else
-                    tokens.push_back(Token(VALUE, word));
-                word.clear();
-            }
-            continue;
-        }
+TokenStream::TokenStream(const std::string& filePath, size_t bufferSize)
+    : _fd(-1), _buffer(bufferSize ? bufferSize : 1), _pos(0), _end(0), _eof(false)
+{
+    initDirectives();
+    _fd = open(filePath.c_str(), O_RDONLY);
+    if (_fd < 0)
+        throw std::runtime_error("Failed to open the file");
+}
 
-        if (c == '{')
-        {
-            if (!word.empty()) {
-                if (is_keyword(word))
-                    tokens.push_back(Token(KEYWORD, word));
-                else
-                    tokens.push_back(Token(VALUE, word));
-                word.clear();
-            }
-            tokens.push_back(Token(BRACE_OPEN, "{"));
-        }
-        else if (c == '}')
-        {
-            if (!word.empty()) {
-                if (is_keyword(word))
-                    tokens.push_back(Token(KEYWORD, word));
-                else
-                    tokens.push_back(Token(VALUE, word));
-                word.clear();
-            }
-            tokens.push_back(Token(BRACE_CLOSE, "}"));
-        }
-        else if (c == ';')
-        {
-            if (!word.empty()) {
-                if (is_keyword(word))
-                    tokens.push_back(Token(KEYWORD, word));
-                else
-                    tokens.push_back(Token(VALUE, word));
-                word.clear();
-            }
-            tokens.push_back(Token(SEMICOLON, ";"));
-        }
-        else if (c == '=')
-        {
-            if (!word.empty()) {
-                if (is_keyword(word))
-                    tokens.push_back(Token(KEYWORD, word));
-                else
-                    tokens.push_back(Token(VALUE, word));
-                word.clear();
-            }
-            tokens.push_back(Token(EQUAL, "="));
-        }
-        else
-        {
-            word += c;
-        }
+TokenStream::~TokenStream()
+{
+    if (_fd >= 0)
+        close(_fd);
+}
+
+// DO: Refill the buffer once everything in it was consumed
+// RETURN: false at the end of the file
+bool TokenStream::fill()
+{
+    if (_pos < _end)
+        return true;
+    if (_eof)
+        return false;
+
+    ssize_t n = read(_fd, &_buffer[0], _buffer.size());
+    if (n < 0)
+        throw std::runtime_error("Failed to read the file");
+    _pos = 0;
+    _end = static_cast<size_t>(n);
+    if (n == 0)
+        _eof = true;
+    return n > 0;
+}
+
+// DO: Read the next token from the file (same rules as Tokenizer::next)
+    // token is overwritten in place so its string capacity is reused from one token to the next
+    // a word may continue across two reads of the buffer
+void TokenStream::next(Token& token)
+{
+    token.text.clear();
+    token.directive = DIR_NONE;
+
+    while (fill() && std::isspace(static_cast<unsigned char>(_buffer[_pos])))
+        ++_pos;
+
+    if (!fill())
+    {
+        token.type = END_OF_FILE;
+        return;
     }
 
-    if (!word.empty())
+    char c = _buffer[_pos];
+    switch (c)
     {
-        if (is_keyword(word))
-            tokens.push_back(Token(KEYWORD, word));
-        else
-            tokens.push_back(Token(VALUE, word));
+        case '{': token.type = BRACE_OPEN; break;
+        case '}': token.type = BRACE_CLOSE; break;
+        case ';': token.type = SEMICOLON; break;
+        case '=': token.type = EQUAL; break;
+        default: token.type = VALUE; break;
+    }
+    if (token.type != VALUE)
+    {
+        token.text.assign(1, c);
+        ++_pos;
+        return;
     }
 
-    tokens.push_back(Token(END_OF_FILE, ""));
-    return tokens;
+    while (fill())
+    {
+        size_t start = _pos;
+        while (_pos < _end)
+        {
+            c = _buffer[_pos];
+            if (std::isspace(static_cast<unsigned char>(c)) || c == '{' || c == '}' || c == ';' || c == '=')
+                break;
+            ++_pos;
+        }
+        token.text.append(&_buffer[start], _pos - start);
+        if (_pos < _end)
+            break;
+    }
+    token.directive = lookupDirective(token.text.data(), token.text.size());
+    if (token.directive != DIR_NONE)
+        token.type = KEYWORD;
 }
@@ -8,6 +8,7 @@
 #include <cctype>
 
 #include "Config.hpp"
+#include "Directive.hpp"
 // TokenType: describes what kind of token we are dealing with
 enum TokenType
 {
@@ -25,18 +26,74 @@ struct Token
 {
     TokenType type;
     std::string text;
+    Directive directive; // which keyword, DIR_NONE unless type is KEYWORD
 
-    Token(TokenType tokenType, const std::string& tokenText)
-        : type(tokenType), text(tokenText) {}
+    Token(TokenType tokenType, const std::string& tokenText, Directive tokenDirective = DIR_NONE)
+        : type(tokenType), text(tokenText), directive(tokenDirective) {}
 };
 
+// TokenView: a token that points into the tokenizer's buffer instead of owning its text
+    // valid as long as the Tokenizer that produced it is alive (see Tokenizer::view, Parser(Tokenizer&))
+struct TokenView
+{
+    TokenType type;
+    size_t offset; // first char in the buffer
+    size_t length; // 0 for END_OF_FILE
+    Directive directive;
+
+    TokenView(TokenType tokenType, size_t tokenOffset, size_t tokenLength, Directive tokenDirective = DIR_NONE)
+        : type(tokenType), offset(tokenOffset), length(tokenLength), directive(tokenDirective) {}
+};
+
+bool is_keyword(const char* word, size_t length);
+bool is_keyword(const std::string& word);
+
 class Tokenizer
 {
 public:
-    Tokenizer(const std::string& filePath);
+    // mapFile: mmap the file instead of reading it into a string (no copy of the content)
+    Tokenizer(const std::string& filePath, bool mapFile = false);
+    ~Tokenizer();
+
     std::vector<Token> tokenize();
+    void tokenize(std::vector<Token>& tokens);
+    TokenView view(size_t& pos, size_t end) const;
+
+    const char* data() const { return _data; }
+    size_t size() const { return _size; }
 
 private:
     std::string _content;
+    const char* _data;  // _content or the mapping
+    size_t _size;
+    void* _mapping;     // NULL when the file was read
+    size_t _mappingSize;
+
+    size_t next(size_t& pos, size_t end, TokenType& type, size_t& start, Directive& directive) const;
+
+    Tokenizer(const Tokenizer&);
+    Tokenizer& operator=(const Tokenizer&);
 };
 
+// TokenStream: pull-based tokenizer, reads the file through a fixed-size buffer
+    // only the token being built is kept in memory, never the whole file or token list
+class TokenStream
+{
+public:
+    TokenStream(const std::string& filePath, size_t bufferSize = 65536);
+    ~TokenStream();
+
+    void next(Token& token);
+
+private:
+    int _fd;
+    std::vector<char> _buffer;
+    size_t _pos;   // next char to read in _buffer
+    size_t _end;   // chars currently in _buffer
+    bool _eof;
+
+    bool fill();
+
+    TokenStream(const TokenStream&);
+    TokenStream& operator=(const TokenStream&);
+};
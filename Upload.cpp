@@ -0,0 +1,396 @@
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE // splice(), pipe2(), mkostemp(), renameat2()
+#endif
+#include "Upload.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Bytes moved by one splice(): the pipe is grown to this when the kernel allows it
+static const size_t PIPE_SIZE = 1024 * 1024;
+
+Upload::Upload()
+    : _status(UPLOAD_MORE), _file(-1), _max(0), _length(0), _received(0), _chunked(false),
+      _state(CHUNK_SIZE), _chunk(0), _digits(0), _meta(0)
+{
+    _pipe[0] = -1;
+    _pipe[1] = -1;
+}
+
+// An upload dropped before it finished leaves no temp file
+Upload::~Upload()
+{
+    if (_status == UPLOAD_MORE)
+        stop(UPLOAD_FAILED);
+}
+
+// DO: The file name an upload is stored under: the rest of the uri after the location path
+// RETURN: false if it is not a plain file name: no '/', no leading '.' (no hidden file, no ".upload-" temp file)
+static bool uploadName(const LocationConfig& location, const std::string& uri, std::string& name) {
+    size_t start = location.path.size() < uri.size() ? location.path.size() : uri.size();
+    while (start < uri.size() && uri[start] == '/')
+        ++start;
+    name = uri.substr(start);
+
+    if (name.empty())
+    {
+        // POST to the location itself: a unique name
+        static unsigned long counter = 0;
+        char generated[64];
+        std::sprintf(generated, "upload-%ld-%ld-%lu", (long)time(NULL), (long)getpid(),
+                     __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED));
+        name = generated;
+        return true;
+    }
+    return name.find('/') == std::string::npos && name[0] != '.';
+}
+
+// DO: Check a POST against its route, before its body is read, and open the temp file
+// RETURN: UPLOAD_MORE to start pumping the body, else the final status
+    // content_length: -1 if the request has none; chunked: Transfer-Encoding: chunked
+UploadStatus Upload::start(const RoutingResult& route, const std::string& uri, long long content_length, bool chunked) {
+    if (!route.server || !route.location || route.location->upload_dir.empty())
+        return (_status = UPLOAD_NOT_FOUND);
+    if (!isMethodAllowed(*route.location, METHOD_POST))
+        return (_status = UPLOAD_NOT_ALLOWED);
+
+    std::string name;
+    if (!uploadName(*route.location, uri, name) || (!chunked && content_length < 0))
+        return (_status = UPLOAD_BAD_REQUEST);
+
+    // the early reject: a too large body is refused before a single byte of it is read
+    _max = route.server->max_body_size;
+    if (!chunked && (unsigned long long)content_length > _max)
+        return (_status = UPLOAD_TOO_LARGE);
+
+    const std::string& dir = route.location->upload_dir;
+    std::string slash = (dir[dir.size() - 1] == '/') ? "" : "/";
+    std::string temp = dir + slash + ".upload-XXXXXX";
+    std::vector<char> pattern(temp.begin(), temp.end());
+    pattern.push_back('\0');
+    _file = mkostemp(&pattern[0], O_CLOEXEC);
+    if (_file < 0)
+        return (_status = UPLOAD_FAILED);
+    _temp = &pattern[0];
+    _path = dir + slash + name;
+    _chunked = chunked;
+    _length = chunked ? -1 : content_length;
+
+    // splice needs a pipe in between; without one the body is read through the buffer
+    if (!chunked && pipe2(_pipe, O_CLOEXEC | O_NONBLOCK) == 0)
+        fcntl(_pipe[1], F_SETPIPE_SZ, (int)PIPE_SIZE);
+    else
+    {
+        _pipe[0] = -1;
+        _pipe[1] = -1;
+    }
+    if (!chunked && content_length == 0)
+        return finish();
+    return UPLOAD_MORE;
+}
+
+// DO: Body bytes the caller already read (with the headers)
+UploadStatus Upload::feed(const char* data, size_t length) {
+    if (_status != UPLOAD_MORE)
+        return _status;
+    if (_chunked)
+        return decode(data, length);
+
+    size_t take = length;
+    if ((unsigned long long)_length - _received < take)
+        take = _length - _received;
+    _extra.append(data + take, length - take);
+    UploadStatus status = write(data, take);
+    if (status != UPLOAD_MORE)
+        return status;
+    return (unsigned long long)_length == _received ? finish() : UPLOAD_MORE;
+}
+
+// DO: Move everything the socket has right now into the file
+// RETURN: UPLOAD_MORE while the body is not complete
+UploadStatus Upload::pump(int socket) {
+    if (_status != UPLOAD_MORE)
+        return _status;
+    if (!_chunked && _pipe[0] >= 0)
+        return spliceBody(socket);
+    return readBody(socket);
+}
+
+// Appends body bytes to the temp file
+UploadStatus Upload::write(const char* data, size_t length) {
+    if (_received + length > _max)
+        return stop(UPLOAD_TOO_LARGE);
+    while (length)
+    {
+        ssize_t n = pwrite(_file, data, length, _received);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return stop(UPLOAD_FAILED);
+        data += n;
+        length -= n;
+        _received += n;
+    }
+    return UPLOAD_MORE;
+}
+
+// DO: Fixed length body: socket -> pipe -> file, the bytes never reach user space
+    // what is spliced into the pipe is always drained to the file before returning
+UploadStatus Upload::spliceBody(int socket) {
+    while ((unsigned long long)_length > _received)
+    {
+        size_t want = _length - _received;
+        if (want > PIPE_SIZE)
+            want = PIPE_SIZE;
+
+        ssize_t in = splice(socket, NULL, _pipe[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (in < 0 && errno == EINTR)
+            continue;
+        if (in < 0 && errno == EAGAIN)
+            return UPLOAD_MORE;
+        if (in < 0 && errno == EINVAL)
+        {
+            // the socket (or the kernel) can't splice: same job through the buffer
+            close(_pipe[0]);
+            close(_pipe[1]);
+            _pipe[0] = -1;
+            _pipe[1] = -1;
+            return readBody(socket);
+        }
+        if (in <= 0)
+            return stop(UPLOAD_BAD_REQUEST); // the client left before the end of the body
+
+        while (in > 0)
+        {
+            loff_t offset = _received;
+            ssize_t out = splice(_pipe[0], NULL, _file, &offset, in, SPLICE_F_MOVE);
+            if (out < 0 && errno == EINTR)
+                continue;
+            if (out < 0 && errno == EINVAL)
+            {
+                // the file system can't take a splice: copy what is in the pipe
+                if (_buffer.empty())
+                    _buffer.resize(BUFFER_SIZE);
+                size_t chunk = (size_t)in < _buffer.size() ? in : _buffer.size();
+                out = read(_pipe[0], &_buffer[0], chunk);
+                if (out <= 0 || write(&_buffer[0], out) != UPLOAD_MORE)
+                    return stop(UPLOAD_FAILED);
+                in -= out;
+                continue;
+            }
+            if (out <= 0)
+                return stop(UPLOAD_FAILED);
+            _received += out;
+            in -= out;
+        }
+    }
+    return finish();
+}
+
+// DO: Chunked body (or no splice): read into the bounded buffer, then decode / write
+UploadStatus Upload::readBody(int socket) {
+    if (_buffer.empty())
+        _buffer.resize(BUFFER_SIZE);
+
+    while (_status == UPLOAD_MORE)
+    {
+        size_t want = _buffer.size();
+        if (!_chunked && (unsigned long long)_length - _received < want)
+            want = _length - _received;
+
+        ssize_t n = read(socket, &_buffer[0], want);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            return UPLOAD_MORE;
+        if (n <= 0)
+            return stop(UPLOAD_BAD_REQUEST);
+
+        UploadStatus status = _chunked ? decode(&_buffer[0], n) : write(&_buffer[0], n);
+        if (status != UPLOAD_MORE)
+            return status;
+        if (!_chunked && (unsigned long long)_length == _received)
+            return finish();
+    }
+    return _status;
+}
+
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// DO: Decode a slice of a chunked body, writing the data as it comes (no copy of it)
+    // size [; extensions] CRLF data CRLF ... 0 CRLF [trailers CRLF] CRLF
+    // bytes after the last CRLF are kept in extra(): they belong to the next request
+UploadStatus Upload::decode(const char* data, size_t length) {
+    size_t i = 0;
+
+    while (i < length)
+    {
+        char c = data[i];
+        switch (_state)
+        {
+            case CHUNK_SIZE:
+            {
+                int d = hexDigit(c);
+                if (d >= 0)
+                {
+                    if (++_digits > 15)
+                        return stop(UPLOAD_BAD_REQUEST);
+                    _chunk = _chunk * 16 + d;
+                }
+                else if (!_digits)
+                    return stop(UPLOAD_BAD_REQUEST);
+                else if (c == ';')
+                {
+                    _state = CHUNK_EXTENSION;
+                    _meta = 0;
+                }
+                else if (c == '\r')
+                    _state = CHUNK_SIZE_LF;
+                else
+                    return stop(UPLOAD_BAD_REQUEST);
+                ++i;
+                break;
+            }
+            case CHUNK_EXTENSION:
+                // capped: extensions carry no body byte, max_body_size would never stop them
+                if (++_meta > MAX_EXTENSION)
+                    return stop(UPLOAD_BAD_REQUEST);
+                if (c == '\r')
+                    _state = CHUNK_SIZE_LF;
+                ++i;
+                break;
+            case CHUNK_SIZE_LF:
+                if (c != '\n')
+                    return stop(UPLOAD_BAD_REQUEST);
+                // checked here: a chunk announcing more than max_body_size is refused before its data
+                if (_received + _chunk > _max)
+                    return stop(UPLOAD_TOO_LARGE);
+                _state = _chunk ? CHUNK_DATA : CHUNK_TRAILER;
+                _digits = 0;
+                _meta = 0;
+                ++i;
+                break;
+            case CHUNK_DATA:
+            {
+                size_t take = length - i;
+                if (_chunk < take)
+                    take = _chunk;
+                UploadStatus status = write(data + i, take);
+                if (status != UPLOAD_MORE)
+                    return status;
+                _chunk -= take;
+                i += take;
+                if (!_chunk)
+                    _state = CHUNK_DATA_CR;
+                break;
+            }
+            case CHUNK_DATA_CR:
+                if (c != '\r')
+                    return stop(UPLOAD_BAD_REQUEST);
+                _state = CHUNK_DATA_LF;
+                ++i;
+                break;
+            case CHUNK_DATA_LF:
+                if (c != '\n')
+                    return stop(UPLOAD_BAD_REQUEST);
+                _state = CHUNK_SIZE;
+                ++i;
+                break;
+            case CHUNK_TRAILER:
+                // start of a line after the last chunk: empty line ends the body
+                if (++_meta > MAX_TRAILERS)
+                    return stop(UPLOAD_BAD_REQUEST);
+                _state = (c == '\r') ? CHUNK_LAST_LF : CHUNK_TRAILER_LINE;
+                ++i;
+                break;
+            case CHUNK_TRAILER_LINE:
+                if (++_meta > MAX_TRAILERS)
+                    return stop(UPLOAD_BAD_REQUEST);
+                if (c == '\n')
+                    _state = CHUNK_TRAILER;
+                ++i;
+                break;
+            case CHUNK_LAST_LF:
+                if (c != '\n')
+                    return stop(UPLOAD_BAD_REQUEST);
+                _state = CHUNK_END;
+                ++i;
+                break;
+            case CHUNK_END:
+                break;
+        }
+        if (_state == CHUNK_END)
+        {
+            _extra.append(data + i, length - i);
+            return finish();
+        }
+    }
+    return UPLOAD_MORE;
+}
+
+// DO: The body is complete: the temp file takes its name, atomically and only if the name is free
+UploadStatus Upload::finish() {
+    if (close(_file) != 0)
+    {
+        _file = -1;
+        return stop(UPLOAD_FAILED);
+    }
+    _file = -1;
+    if (renameat2(AT_FDCWD, _temp.c_str(), AT_FDCWD, _path.c_str(), RENAME_NOREPLACE) != 0)
+    {
+        if (errno != EINVAL && errno != ENOSYS)
+            return stop(errno == EEXIST ? UPLOAD_CONFLICT : UPLOAD_FAILED);
+        // no RENAME_NOREPLACE on this filesystem: link() fails on an existing name too
+        if (link(_temp.c_str(), _path.c_str()) != 0)
+            return stop(errno == EEXIST ? UPLOAD_CONFLICT : UPLOAD_FAILED);
+        unlink(_temp.c_str());
+    }
+    _temp.clear();
+    return stop(UPLOAD_DONE);
+}
+
+// DO: End the upload with status: close everything, remove the temp file if it is still there
+// RETURN: status, now final
+UploadStatus Upload::stop(UploadStatus status) {
+    if (_file >= 0)
+        close(_file);
+    _file = -1;
+    if (_pipe[0] >= 0)
+        close(_pipe[0]);
+    if (_pipe[1] >= 0)
+        close(_pipe[1]);
+    _pipe[0] = -1;
+    _pipe[1] = -1;
+    if (!_temp.empty())
+        unlink(_temp.c_str());
+    _temp.clear();
+    std::vector<char>().swap(_buffer);
+    _status = status;
+    return status;
+}
+
+// HTTP status to answer an upload with
+int uploadStatusCode(UploadStatus status) {
+    switch (status)
+    {
+        case UPLOAD_MORE: return 100;
+        case UPLOAD_DONE: return 201;
+        case UPLOAD_NOT_FOUND: return 404;
+        case UPLOAD_NOT_ALLOWED: return 405;
+        case UPLOAD_TOO_LARGE: return 413;
+        case UPLOAD_BAD_REQUEST: return 400;
+        case UPLOAD_CONFLICT: return 409;
+        case UPLOAD_FAILED: return 500;
+    }
+    return 500;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Router.hpp"
+
+// What an upload says after each step
+enum UploadStatus
+{
+    UPLOAD_MORE,            // waiting for more of the body: pump() again when the socket is readable
+    UPLOAD_DONE,            // stored at path()
+    UPLOAD_NOT_FOUND,       // no server / location, or the location has no upload_dir
+    UPLOAD_NOT_ALLOWED,     // POST is not allowed in that location
+    UPLOAD_TOO_LARGE,       // over the server's max_body_size
+    UPLOAD_BAD_REQUEST,     // no length, bad file name, bad chunked encoding, or the client left early
+    UPLOAD_CONFLICT,        // a file of that name already exists: it is not replaced
+    UPLOAD_FAILED           // the file could not be written
+};
+
+// Upload: the body of a POST routed to a location with upload_dir, streamed to a file
+    // 1. start() checks the route and Content-Length against max_body_size before any body byte is read
+    // 2. the body goes to a temp file in upload_dir: a fixed length one with splice() (socket -> pipe -> file,
+    //    no copy to user space), a chunked one decoded from a bounded buffer and written with pwrite()
+    // 3. once complete the temp file is renamed to its name, never over an existing file: nobody sees a
+    //    half written file, and an upload can't replace another one (or its temp file)
+    // memory stays bounded whatever the size of the body; a failed or abandoned upload leaves nothing behind
+    // not thread safe: one per request
+class Upload
+{
+public:
+    static const size_t BUFFER_SIZE = 64 * 1024;
+    static const size_t MAX_EXTENSION = 4096;   // bytes of chunk extension per chunk
+    static const size_t MAX_TRAILERS = 8192;    // bytes of trailer section after the last chunk
+
+    Upload();
+    ~Upload();
+
+    UploadStatus start(const RoutingResult& route, const std::string& uri, long long content_length, bool chunked);
+    UploadStatus feed(const char* data, size_t length);
+    UploadStatus pump(int socket);
+
+    const std::string& path() const { return _path; }
+    unsigned long long received() const { return _received; }
+    const std::string& extra() const { return _extra; }
+
+private:
+    // chunked decoder states
+    enum ChunkState
+    {
+        CHUNK_SIZE, CHUNK_SIZE_LF, CHUNK_EXTENSION, CHUNK_DATA, CHUNK_DATA_CR, CHUNK_DATA_LF,
+        CHUNK_TRAILER, CHUNK_TRAILER_LINE, CHUNK_LAST_LF, CHUNK_END
+    };
+
+    UploadStatus _status;  // where the upload stands, final once not UPLOAD_MORE
+    int _file;
+    int _pipe[2];          // for splice(), -1 when splice() is not usable
+    std::string _temp;
+    std::string _path;
+    unsigned long long _max;
+    long long _length;     // -1: chunked
+    unsigned long long _received;
+    bool _chunked;
+    ChunkState _state;
+    unsigned long long _chunk; // bytes left in the current chunk (or its size while reading it)
+    int _digits;
+    size_t _meta;          // bytes of the current chunk extension, or of the trailers so far
+    std::vector<char> _buffer;
+    std::string _extra;    // bytes read after a chunked body: the start of the next request
+
+    UploadStatus write(const char* data, size_t length);
+    UploadStatus decode(const char* data, size_t length);
+    UploadStatus spliceBody(int socket);
+    UploadStatus readBody(int socket);
+    UploadStatus finish();
+    UploadStatus stop(UploadStatus status);
+
+    Upload(const Upload&);
+    Upload& operator=(const Upload&);
+};
+
+int uploadStatusCode(UploadStatus status);
@@ -0,0 +1,157 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../Autoindex.hpp"
+
+// autoindex [entries]
+    // renderAutoindex and AutoindexCache::listing over a directory of `entries` files under /tmp
+    // (us per listing), then the cache's behaviour, each line ok or FAILED: hit, invalidation by the
+    // directory's mtime, re-render of a racy listing, LRU eviction, escaping and a missing directory
+    // exits 1 if a check failed
+
+static const char* g_dir = "/tmp/webserv_bench_autoindex";
+static int g_failed = 0;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static std::string path(const std::string& directory, const std::string& name) {
+    return directory + "/" + name;
+}
+
+static void touchFile(const std::string& file) {
+    int fd = open(file.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd >= 0)
+        close(fd);
+}
+
+// Set the mtime of a directory, seconds ago (0: now, which makes its listing racy)
+static struct timespec setMtime(const std::string& directory, long ago) {
+    struct timespec times[2];
+    clock_gettime(CLOCK_REALTIME, &times[0]);
+    times[0].tv_sec -= ago;
+    times[1] = times[0];
+    utimensat(AT_FDCWD, directory.c_str(), times, 0);
+    return times[1];
+}
+
+static void restoreMtime(const std::string& directory, const struct timespec& mtime) {
+    struct timespec times[2] = { mtime, mtime };
+    utimensat(AT_FDCWD, directory.c_str(), times, 0);
+}
+
+static std::string makeDirectory(const std::string& name, size_t files) {
+    std::string directory = path(g_dir, name);
+    mkdir(g_dir, 0755);
+    mkdir(directory.c_str(), 0755);
+    for (size_t i = 0; i < files; ++i)
+    {
+        char file[32];
+        std::snprintf(file, sizeof(file), "file_%06lu.html", (unsigned long)i);
+        touchFile(path(directory, file));
+    }
+    return directory;
+}
+
+static bool contains(const std::string& html, const std::string& text) {
+    return html.find(text) != std::string::npos;
+}
+
+static void check(const char* name, bool ok) {
+    std::printf("  %-58s %s\n", name, ok ? "ok" : "FAILED");
+    if (!ok)
+        ++g_failed;
+}
+
+int main(int argc, char* argv[]) {
+    size_t entries = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 20000;
+
+    {
+        std::string big = makeDirectory("big", entries);
+        setMtime(big, 60);
+        AutoindexCache cache;
+        size_t rounds = 20;
+
+        double t = now();
+        for (size_t i = 0; i < rounds; ++i)
+            renderAutoindex(big, "/big/");
+        double render = (now() - t) / rounds * 1e6;
+        cache.listing(big, "/big/");
+        size_t hits = 100000;
+        t = now();
+        for (size_t i = 0; i < hits; ++i)
+            cache.listing(big, "/big/");
+        double hit = (now() - t) / hits * 1e6;
+        std::printf("%lu entries\n", (unsigned long)entries);
+        std::printf("  renderAutoindex          %10.1f us/listing\n", render);
+        std::printf("  AutoindexCache hit       %10.3f us/listing   hits %lu misses %lu\n",
+                    hit, cache.stats().hits, cache.stats().misses);
+    }
+
+    // ttl 0: every lookup compares the directory's mtime
+    std::string dir = makeDirectory("small", 3);
+    setMtime(dir, 60);
+    AutoindexCache cache(2, 0);
+
+    // hit: the same page, rendered once
+    const std::string& first = cache.listing(dir, "/small/");
+    std::string page = first;
+    const std::string& second = cache.listing(dir, "/small/");
+    check("hit: one miss then one hit, same page", cache.stats().misses == 1 && cache.stats().hits == 1
+          && second == page && contains(page, "file_000002.html"));
+
+    // mtime: adding an entry moves the directory's mtime, the page is rendered again
+    touchFile(path(dir, "added.html"));
+    setMtime(dir, 30);
+    const std::string& changed = cache.listing(dir, "/small/");
+    check("mtime: a new entry is listed", cache.stats().misses == 2 && contains(changed, "added.html"));
+    check("mtime: then served from the cache again", cache.listing(dir, "/small/") == changed
+          && cache.stats().misses == 2);
+
+    // racy: changed in the last second, the mtime may not move again for an entry added in the same tick
+    struct timespec racy = setMtime(dir, 0);
+    cache.listing(dir, "/small/");
+    unsigned long misses = cache.stats().misses;
+    touchFile(path(dir, "late.html"));
+    restoreMtime(dir, racy);
+    const std::string& late = cache.listing(dir, "/small/");
+    check("racy: rendered again although the mtime did not move", cache.stats().misses == misses + 1
+          && contains(late, "late.html"));
+    setMtime(dir, 10);
+
+    // LRU: one entry per (directory, uri), the least recently used goes past capacity
+    unsigned long evictions = cache.stats().evictions;
+    cache.listing(dir, "/a/");
+    cache.listing(dir, "/b/");
+    check("LRU: past capacity an entry is evicted", cache.stats().evictions > evictions);
+    misses = cache.stats().misses;
+    const std::string& again = cache.listing(dir, "/small/");
+    check("LRU: the evicted listing is rendered again", cache.stats().misses == misses + 1
+          && contains(again, "Index of /small/"));
+
+    // escaping: names go through HTML escaping, links through percent-encoding
+    touchFile(path(dir, "a <b>&c.html"));
+    std::string escaped = renderAutoindex(dir, "/small");
+    check("escaping: HTML text and URL encoded links", contains(escaped, ">a &lt;b&gt;&amp;c.html</a>")
+          && contains(escaped, "href=\"/small/a%20%3Cb%3E%26c.html\""));
+
+    bool thrown = false;
+    try
+    {
+        cache.listing(path(g_dir, "missing"), "/missing/");
+    }
+    catch (const std::exception&)
+    {
+        thrown = true;
+    }
+    check("missing directory: throws", thrown);
+
+    return g_failed ? 1 : 0;
+}
@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "../Cgi.hpp"
+
+// cgi_pool [requests] [threads] [body bytes]
+    // the same echo script run fork-per-request (runCgi) and by a CgiPool of `threads` workers,
+    // from `threads` client threads; then the pool's backpressure, timeout, restart and FCGI_OVERLOADED handling
+// cgi_pool --echo: the echo script itself, plain CGI or FastCGI like php-cgi: FastCGI when fd 0 is listening
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ---- the echo script ----
+
+static const char* g_headers = "Content-Type: text/plain\r\n\r\n";
+
+static bool writeAll(int fd, const char* data, size_t length) {
+    while (length)
+    {
+        ssize_t n = write(fd, data, length);
+        if (n <= 0)
+            return false;
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+static bool readAll(int fd, char* data, size_t length) {
+    while (length)
+    {
+        ssize_t n = read(fd, data, length);
+        if (n <= 0)
+            return false;
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+static void writeRecord(int fd, unsigned char type, const std::string& data) {
+    unsigned char header[8] = { 1, type, 0, 1, (unsigned char)(data.size() >> 8), (unsigned char)data.size(), 0, 0 };
+    writeAll(fd, (const char*)header, 8);
+    writeAll(fd, data.data(), data.size());
+}
+
+// a body of "slow" takes 100 ms, "slower" 300 ms, one of "sleep" hangs the script: for the timeout
+    // one of "overloaded" is turned down with FCGI_OVERLOADED by the FastCGI side
+static std::string echo(const std::string& body) {
+    if (body == "sleep")
+        sleep(10);
+    if (body == "slow")
+        usleep(100000);
+    if (body == "slower")
+        usleep(300000);
+    return g_headers + body;
+}
+
+static int echoFastcgi() {
+    while (true)
+    {
+        int fd = accept(0, NULL, NULL);
+        if (fd < 0)
+            return errno == EINTR ? 0 : 1;
+        std::string body;
+        unsigned char header[8];
+        std::vector<char> content;
+        // records until the empty FCGI_STDIN
+        while (readAll(fd, (char*)header, 8))
+        {
+            size_t length = (header[4] << 8) | header[5];
+            content.resize(length + header[6] + 1);
+            if (!readAll(fd, &content[0], length + header[6]))
+                break;
+            if (header[1] != 5)
+                continue;
+            if (!length && body == "overloaded")
+            {
+                std::string end(8, '\0');
+                end[4] = 2;
+                writeRecord(fd, 3, end);
+                break;
+            }
+            if (!length)
+            {
+                std::string out = echo(body);
+                for (size_t at = 0; at < out.size(); at += 65535)
+                    writeRecord(fd, 6, out.substr(at, 65535));
+                writeRecord(fd, 6, "");
+                writeRecord(fd, 3, std::string(8, '\0'));
+                break;
+            }
+            body.append(&content[0], length);
+        }
+        close(fd);
+    }
+}
+
+static int echoCgi() {
+    std::string body;
+    char buffer[16384];
+    ssize_t n;
+    while ((n = read(0, buffer, sizeof(buffer))) > 0)
+        body.append(buffer, n);
+    std::string out = echo(body);
+    return writeAll(1, out.data(), out.size()) ? 0 : 1;
+}
+
+static int echoScript() {
+    struct sockaddr addr;
+    socklen_t length = sizeof(addr);
+    if (getpeername(0, &addr, &length) != 0 && errno == ENOTCONN)
+        return echoFastcgi();
+    return echoCgi();
+}
+
+// ---- the clients ----
+
+struct Client
+{
+    CgiPool* pool;                  // NULL: fork per request
+    const std::vector<std::string>* argv;
+    const CgiRequest* request;
+    size_t requests;
+    std::vector<double> latencies;  // µs
+    size_t errors;
+};
+
+static void* client(void* arg) {
+    Client& c = *static_cast<Client*>(arg);
+    std::string expected = g_headers + c.request->body;
+
+    for (size_t i = 0; i < c.requests; ++i)
+    {
+        double t = now();
+        CgiResult result = c.pool ? c.pool->run(".echo", *c.request) : runCgi(*c.argv, *c.request, 30000);
+        c.latencies.push_back((now() - t) * 1e6);
+        if (result.status != CGI_DONE || result.output != expected)
+            ++c.errors;
+    }
+    return NULL;
+}
+
+static void run(const char* name, CgiPool* pool, const std::vector<std::string>& argv,
+                        const CgiRequest& request, size_t requests, size_t threads)
+{
+    std::vector<Client> clients(threads);
+    std::vector<pthread_t> ids(threads);
+    double t = now();
+    for (size_t i = 0; i < threads; ++i)
+    {
+        clients[i].pool = pool;
+        clients[i].argv = &argv;
+        clients[i].request = &request;
+        clients[i].requests = requests / threads;
+        clients[i].errors = 0;
+        pthread_create(&ids[i], NULL, client, &clients[i]);
+    }
+    std::vector<double> latencies;
+    size_t errors = 0;
+    for (size_t i = 0; i < threads; ++i)
+    {
+        pthread_join(ids[i], NULL);
+        latencies.insert(latencies.end(), clients[i].latencies.begin(), clients[i].latencies.end());
+        errors += clients[i].errors;
+    }
+    t = now() - t;
+
+    std::sort(latencies.begin(), latencies.end());
+    std::printf("  %-18s %9.0f req/s   p50 %8.1f us   p99 %8.1f us   errors %lu\n", name, latencies.size() / t,
+                latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100], (unsigned long)errors);
+}
+
+struct Burst
+{
+    CgiPool* pool;
+    const CgiRequest* request;
+    int code;
+};
+
+static void* burst(void* arg) {
+    Burst& b = *static_cast<Burst*>(arg);
+    b.code = cgiStatusCode(b.pool->run(".echo", *b.request).status);
+    return NULL;
+}
+
+// DO: Run `count` requests at once, print their status codes in order
+static void runBurst(const char* name, CgiPool& pool, const CgiRequest& request, size_t count) {
+    std::vector<Burst> bursts(count);
+    std::vector<pthread_t> ids(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        bursts[i].pool = &pool;
+        bursts[i].request = &request;
+        pthread_create(&ids[i], NULL, burst, &bursts[i]);
+    }
+    std::vector<int> codes;
+    for (size_t i = 0; i < count; ++i)
+    {
+        pthread_join(ids[i], NULL);
+        codes.push_back(bursts[i].code);
+    }
+    std::sort(codes.begin(), codes.end());
+    std::printf("  %s:", name);
+    for (size_t i = 0; i < count; ++i)
+        std::printf(" %d", codes[i]);
+    std::printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "--echo") == 0)
+        return echoScript();
+    size_t requests = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 4000;
+    size_t threads = argc > 2 ? std::strtoul(argv[2], NULL, 10) : 4;
+    size_t bytes = argc > 3 ? std::strtoul(argv[3], NULL, 10) : 1024;
+
+    char self[4096];
+    ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (length <= 0)
+        return 1;
+    self[length] = '\0';
+    std::vector<std::string> script;
+    script.push_back(self);
+    script.push_back("--echo");
+
+    CgiRequest request;
+    request.method = "POST";
+    request.script = "/tmp/echo.echo";
+    request.uri = "/echo.echo";
+    request.content_type = "text/plain";
+    request.body.assign(bytes, 'x');
+
+    std::printf("%lu requests, %lu threads, %lu byte bodies\n", (unsigned long)requests,
+                (unsigned long)threads, (unsigned long)bytes);
+    run("fork per request", NULL, script, request, requests, threads);
+    {
+        CgiOptions options;
+        options.workers = threads;
+        CgiPool pool(options);
+        pool.add(".echo", script);
+        run("pool", &pool, script, request, requests, threads);
+        CgiStats stats = pool.stats();
+        std::printf("  pool: %lu requests, %lu restarts\n", stats.requests, stats.restarts);
+    }
+
+    // one worker restarted every 100 requests, a queue of 2 and a 500 ms timeout
+    CgiOptions options;
+    options.workers = 1;
+    options.max_requests = 100;
+    options.queue = 2;
+    options.timeout_ms = 500;
+    CgiPool pool(options);
+    pool.add(".echo", script);
+    run("pool, 1 worker", &pool, script, request, requests, 1);
+
+    // a burst of 6 slow requests at once: 1 runs, 2 wait in the queue and run next, 3 are refused straight away
+    request.body = "slow";
+    runBurst("burst of 6", pool, request, 6);
+
+    // 3 requests of 300 ms: the second waits 300 ms of its 500 and still gets 500 ms to run, the third
+    // gives up queued; no worker is killed for time it spent in the queue
+    request.body = "slower";
+    unsigned long restarts = pool.stats().restarts;
+    runBurst("queued 300 ms", pool, request, 3);
+    std::printf("  restarts during it: %lu\n", pool.stats().restarts - restarts);
+
+    request.body = "sleep";
+    double t = now();
+    CgiResult result = pool.run(".echo", request);
+    std::printf("  hung script: %d after %.0f ms\n", cgiStatusCode(result.status), (now() - t) * 1e3);
+    request.body = "back";
+    result = pool.run(".echo", request);
+    std::printf("  next request: %d\n", cgiStatusCode(result.status));
+    request.body = "overloaded";
+    result = pool.run(".echo", request);
+    std::printf("  overloaded worker: %d\n", cgiStatusCode(result.status));
+    CgiStats stats = pool.stats();
+    std::printf("  pool: %lu requests, %lu refused, %lu restarts, %lu timeouts\n", stats.requests, stats.refused,
+                stats.restarts, stats.timeouts);
+    return 0;
+}
@@ -0,0 +1,247 @@
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "../Router.hpp"
+
+// config_scale [servers] [locations] [names] [requests] [seed]
+    // writes a synthetic config (N servers x M locations x K server names), then reports
+    // load time (loadConfig's tokenize + parse) and peak RSS, and routing latency percentiles and throughput
+    // for a mix of hits, index hits, 404s and redirects
+    // same arguments and seed: same config and same requests, so runs can be compared
+
+static const char* g_root = "/tmp/webserv_bench_www";
+static const char* g_conf = "/tmp/webserv_bench_scale.conf";
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Peak resident set size of the process so far, in KiB
+static long peakRss() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void touch(const std::string& path) {
+    FILE* f = std::fopen(path.c_str(), "w");
+    if (f)
+        std::fclose(f);
+}
+
+// DO: The small real tree every location is rooted in: hits have to reach real files
+static void makeTree() {
+    mkdir(g_root, 0755);
+    mkdir((std::string(g_root) + "/static").c_str(), 0755);
+    touch(std::string(g_root) + "/index.html");
+    touch(std::string(g_root) + "/static/app.js");
+}
+
+// DO: Write the config: every server listens on one of 4 ports and has `names` names,
+    // `locations` static locations and one redirect
+// RETURN: the size of the file in bytes
+static long writeConfig(size_t servers, size_t locations, size_t names) {
+    FILE* f = std::fopen(g_conf, "w");
+    if (!f)
+        throw std::runtime_error("Cannot write bench config");
+
+    for (size_t s = 0; s < servers; ++s)
+    {
+        std::fprintf(f, "server {\n    listen 127.0.0.1:%d;\n", 8080 + (int)(s % 4));
+        for (size_t n = 0; n < names; ++n)
+            std::fprintf(f, "    server_name n%lu.tenant%lu.example.com;\n", (unsigned long)n, (unsigned long)s);
+        std::fprintf(f, "    error_page 404 /404.html;\n");
+        for (size_t l = 0; l < locations; ++l)
+            std::fprintf(f, "    location /app%lu {\n        root %s;\n        index index.html;\n"
+                            "        methods GET POST;\n    }\n", (unsigned long)l, g_root);
+        std::fprintf(f, "    location /legacy {\n        redirection = \"http://example.com/new\";\n        methods GET;\n    }\n}\n");
+    }
+    long size = std::ftell(f);
+    std::fclose(f);
+    return size;
+}
+
+enum Kind { HIT, INDEX_HIT, NOT_FOUND, REDIRECT, KIND_COUNT };
+static const char* g_kinds[KIND_COUNT] = { "hit", "index", "404", "redirect" };
+
+struct Request
+{
+    std::string host;
+    int port;
+    std::string uri;
+    Kind kind;
+};
+
+// Realistic mix: 60% files, 15% directories with an index, 15% missing files, 10% redirects
+    // hosts follow a skewed distribution: a few tenants take most of the traffic
+static std::vector<Request> makeRequests(size_t count, size_t servers, size_t locations, size_t names) {
+    std::vector<Request> requests(count);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        size_t s = (std::rand() % 4 == 0) ? std::rand() % servers : std::rand() % (servers < 16 ? servers : 16);
+        int r = std::rand() % 100;
+        char host[96];
+        char uri[96];
+        unsigned long loc = std::rand() % locations;
+
+        std::sprintf(host, "n%lu.tenant%lu.example.com", (unsigned long)(std::rand() % names), (unsigned long)s);
+        Request& q = requests[i];
+        q.host = host;
+        q.port = 8080 + (int)(s % 4);
+        if (r < 60)
+        {
+            std::sprintf(uri, "/app%lu/static/app.js", loc);
+            q.kind = HIT;
+        }
+        else if (r < 75)
+        {
+            std::sprintf(uri, "/app%lu/", loc);
+            q.kind = INDEX_HIT;
+        }
+        else if (r < 90)
+        {
+            std::sprintf(uri, "/app%lu/missing%d.png", loc, r);
+            q.kind = NOT_FOUND;
+        }
+        else
+        {
+            std::sprintf(uri, "/legacy");
+            q.kind = REDIRECT;
+        }
+        q.uri = uri;
+    }
+    return requests;
+}
+
+static double percentile(std::vector<double>& sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    size_t i = (size_t)(p * (sorted.size() - 1));
+    return sorted[i];
+}
+
+// DO: One line of latency percentiles (microseconds) for a set of samples
+static void report(const char* name, std::vector<double>& samples, double seconds) {
+    std::sort(samples.begin(), samples.end());
+    std::printf("  %-10s %8lu  p50 %7.2f  p90 %7.2f  p99 %7.2f  p99.9 %8.2f  max %8.2f us",
+                name, (unsigned long)samples.size(),
+                percentile(samples, 0.50) * 1e6, percentile(samples, 0.90) * 1e6,
+                percentile(samples, 0.99) * 1e6, percentile(samples, 0.999) * 1e6,
+                samples.empty() ? 0 : samples.back() * 1e6);
+    if (seconds > 0)
+        std::printf("  %10.0f req/s", samples.size() / seconds);
+    std::printf("\n");
+}
+
+// Routing engines to compare: the throwing routingResult main uses, and resolveRoute
+static bool routeThrowing(const Config& config, const Request& q) {
+    try
+    {
+        routingResult(config, q.host, q.port, q.uri, "GET");
+        return true;
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+}
+
+static bool routeStatus(const Config& config, const Request& q) {
+    RouteStatus status = resolveRoute(config, q.host, q.port, q.uri, METHOD_GET).status;
+    return status == ROUTE_OK || status == ROUTE_REDIRECT;
+}
+
+// DO: Route every request once, timing each call
+static void measure(const char* engine, bool (*route)(const Config&, const Request&),
+                        const Config& config, const std::vector<Request>& requests)
+{
+    std::vector<double> all;
+    std::vector<double> kinds[KIND_COUNT];
+    size_t ok = 0;
+
+    all.reserve(requests.size());
+    // warm-up: the dentry cache and the branch predictors, not what we measure
+    for (size_t i = 0; i < requests.size() && i < 1000; ++i)
+        route(config, requests[i]);
+
+    double start = now();
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        double t = now();
+        ok += route(config, requests[i]);
+        t = now() - t;
+        all.push_back(t);
+        kinds[requests[i].kind].push_back(t);
+    }
+    double total = now() - start;
+
+    std::printf("%s (%lu served):\n", engine, (unsigned long)ok);
+    report("all", all, total);
+    for (int k = 0; k < KIND_COUNT; ++k)
+        report(g_kinds[k], kinds[k], 0);
+}
+
+int main(int argc, char* argv[]) {
+    size_t servers = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 200;
+    size_t locations = argc > 2 ? std::strtoul(argv[2], NULL, 10) : 50;
+    size_t names = argc > 3 ? std::strtoul(argv[3], NULL, 10) : 4;
+    size_t count = argc > 4 ? std::strtoul(argv[4], NULL, 10) : 200000;
+    unsigned int seed = argc > 5 ? std::strtoul(argv[5], NULL, 10) : 42;
+
+    if (!servers || !locations || !names)
+    {
+        std::fprintf(stderr, "usage: %s [servers] [locations] [names] [requests] [seed]\n", argv[0]);
+        return 1;
+    }
+    std::srand(seed);
+    makeTree();
+    long bytes = writeConfig(servers, locations, names);
+    std::printf("%lu servers x %lu locations x %lu names: %ld bytes, seed %u\n",
+                (unsigned long)servers, (unsigned long)locations, (unsigned long)names, bytes, seed);
+
+    // the mapped file parsed in place on one thread, then what loadConfig does on a cache miss:
+    // the same with the server blocks parsed in parallel (the first run also pays the page faults)
+    long rss = peakRss();
+    double t = now();
+    {
+        Tokenizer text(g_conf, true);
+        Parser serial(text);
+        serial.parse();
+    }
+    double serial = now() - t;
+
+    t = now();
+    Tokenizer tokenizer(g_conf, true);
+    Parser parser(tokenizer);
+    Config config = parser.parseParallel();
+    double load = now() - t;
+    long loaded = peakRss();
+
+    // the same file through TokenStream's fixed read buffer
+    t = now();
+    {
+        TokenStream stream(g_conf);
+        Parser streamed(stream);
+        streamed.parse();
+    }
+    double streamed = now() - t;
+
+    std::printf("  load     %9.3f ms  (mapped file, parseParallel as loadConfig; tokenize + parse + compileRoutes, %.1f MB/s)\n",
+                load * 1000, bytes / load / 1e6);
+    std::printf("  serial   %9.3f ms  (mapped file, parse(); parallel speedup %.1fx on %ld CPUs)\n",
+                serial * 1000, serial / load, sysconf(_SC_NPROCESSORS_ONLN));
+    std::printf("  stream   %9.3f ms  (TokenStream, same parse)\n", streamed * 1000);
+    std::printf("  peak RSS %9ld KiB  (+%ld KiB while loading)\n", loaded, loaded - rss);
+
+    std::vector<Request> requests = makeRequests(count, servers, locations, names);
+    measure("routingResult", &routeThrowing, config, requests);
+    measure("resolveRoute", &routeStatus, config, requests);
+    return 0;
+}
@@ -0,0 +1,199 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../OpenFileCache.hpp"
+
+// open_file_cache [requests]
+    // resolveRoute with and without an OpenFileCache over a small tree under /tmp (ns per request),
+    // then the cache's behaviour, each line ok or FAILED: hit, revalidation after `valid`, inactive expiry
+    // (also out of last-use order), LRU eviction while a file is still acquired, the index file handoff,
+    // and a cache destroyed while a response still holds its fd
+    // exits 1 if a check failed
+
+static const char* g_dir = "/tmp/webserv_bench_ofc";
+static const long VALID_MS = 50;
+static const long INACTIVE_MS = 200;
+static const size_t CAPACITY = 4;
+static int g_failed = 0;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleepMs(long ms) {
+    usleep(ms * 1000);
+}
+
+static void writeFile(const std::string& name, const std::string& content) {
+    std::string path = std::string(g_dir) + "/" + name;
+    FILE* f = std::fopen(path.c_str(), "w");
+    if (f)
+    {
+        std::fwrite(content.data(), 1, content.size(), f);
+        std::fclose(f);
+    }
+}
+
+// What is at the start of an fd, read without moving its offset (like sendfile() with an offset)
+static std::string readFd(int fd) {
+    char buffer[256];
+    ssize_t n = pread(fd, buffer, sizeof(buffer), 0);
+    return n > 0 ? std::string(buffer, n) : std::string();
+}
+
+static bool isOpen(int fd) {
+    return fcntl(fd, F_GETFD) != -1 || errno != EBADF;
+}
+
+static void check(const char* name, bool ok) {
+    std::printf("  %-58s %s\n", name, ok ? "ok" : "FAILED");
+    if (!ok)
+        ++g_failed;
+}
+
+static Config makeConfig(size_t cache) {
+    mkdir(g_dir, 0755);
+    writeFile("index.html", "index");
+    for (char c = 'a'; c <= 'h'; ++c)
+        writeFile(std::string(1, c) + ".html", std::string(1, c));
+
+    Config config;
+    config.servers.resize(1);
+    ServerConfig& server = config.servers[0];
+    HostPort hp;
+    hp.listen_host = "127.0.0.1";
+    hp.listen_port = 8080;
+    server.listens.push_back(hp);
+    server.open_file_cache = cache;
+    server.open_file_valid = VALID_MS;
+    server.open_file_inactive = INACTIVE_MS;
+    LocationConfig loc;
+    loc.path = "/";
+    loc.root = std::string(g_dir) + "/";
+    loc.index = "index.html";
+    loc.methods = METHOD_GET;
+    server.locations.push_back(loc);
+    compileRoutes(config);
+    return config;
+}
+
+static RoutingResult get(const Config& config, OpenFileCache& files, const std::string& uri) {
+    return resolveRoute(config, "localhost", 8080, uri, METHOD_GET, files);
+}
+
+// ns per resolveRoute over the files of the tree, released right away
+static double timeRoutes(const Config& config, OpenFileCache& files, size_t requests) {
+    static const char* uris[] = { "/a.html", "/b.html", "/c.html", "/" };
+    double t = now();
+    for (size_t i = 0; i < requests; ++i)
+    {
+        RoutingResult r = get(config, files, uris[i % 4]);
+        OpenFileCache::release(r.open_file);
+    }
+    return (now() - t) / requests * 1e9;
+}
+
+int main(int argc, char* argv[]) {
+    size_t requests = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 200000;
+
+    {
+        Config plain = makeConfig(0);
+        OpenFileCache none(openFileCacheCapacity(plain));
+        Config cached = makeConfig(16);
+        OpenFileCache files(openFileCacheCapacity(cached));
+        std::printf("%lu requests over 4 uris\n", (unsigned long)requests);
+        std::printf("  no open_file_cache      %8.0f ns/request\n", timeRoutes(plain, none, requests));
+        double ns = timeRoutes(cached, files, requests);
+        std::printf("  open_file_cache 16      %8.0f ns/request   hits %lu misses %lu\n",
+                    ns, files.stats().hits, files.stats().misses);
+    }
+
+    Config config = makeConfig(CAPACITY);
+    check("openFileCacheCapacity is the server's open_file_cache", openFileCacheCapacity(config) == CAPACITY);
+    OpenFileCache files(openFileCacheCapacity(config));
+
+    // hit: the second request shares the first one's fd
+    RoutingResult first = get(config, files, "/a.html");
+    RoutingResult second = get(config, files, "/a.html");
+    check("hit: same open file, one miss then one hit", first.open_file && first.open_file == second.open_file
+          && files.stats().misses == 1 && files.stats().hits == 1 && readFd(first.open_file->fd) == "a");
+    OpenFileCache::release(first.open_file);
+    OpenFileCache::release(second.open_file);
+
+    // revalidation: within `valid` the fd is trusted, after it the path is compared and the file reopened
+    writeFile("a.html", "a, edited");
+    RoutingResult trusted = get(config, files, "/a.html");
+    check("within valid: the old fd is still served", trusted.open_file && trusted.file.size == 1);
+    OpenFileCache::release(trusted.open_file);
+    sleepMs(VALID_MS + 20);
+    RoutingResult reopened = get(config, files, "/a.html");
+    check("after valid: a changed file is reopened", reopened.open_file && reopened.file.size == 9
+          && readFd(reopened.open_file->fd) == "a, edited");
+    OpenFileCache::release(reopened.open_file);
+    sleepMs(VALID_MS + 20);
+    unsigned long hits = files.stats().hits;
+    RoutingResult unchanged = get(config, files, "/a.html");
+    check("after valid: an unchanged file keeps its fd", unchanged.open_file && files.stats().hits == hits + 1
+          && readFd(unchanged.open_file->fd) == "a, edited");
+    OpenFileCache::release(unchanged.open_file);
+
+    // inactive: an entry unused for `inactive` is closed by the next acquire()
+    RoutingResult idle = get(config, files, "/b.html");
+    OpenFileCache::release(idle.open_file);
+    sleepMs(INACTIVE_MS + 20);
+    unsigned long evictions = files.stats().evictions;
+    OpenFileCache::release(get(config, files, "/c.html").open_file);
+    check("inactive: idle entries are closed", files.size() == 1 && files.stats().evictions == evictions + 2);
+
+    // inactive is per location: an entry used later but with a shorter inactive expires first
+    OpenFileCache::release(files.acquire(std::string(g_dir) + "/a.html", VALID_MS, 10000));
+    OpenFileCache::release(files.acquire(std::string(g_dir) + "/b.html", VALID_MS, 30));
+    sleepMs(50);
+    evictions = files.stats().evictions;
+    OpenFileCache::release(get(config, files, "/c.html").open_file);
+    check("inactive: a shorter inactive behind a longer one expires", files.size() == 2
+          && files.stats().evictions == evictions + 1);
+
+    // LRU: past capacity the least recently used entry goes, but an acquired fd stays open until release()
+    RoutingResult held = get(config, files, "/d.html");
+    int held_fd = held.open_file ? held.open_file->fd : -1;
+    const char* others[] = { "/e.html", "/f.html", "/g.html", "/h.html" };
+    for (size_t i = 0; i < 4; ++i)
+        OpenFileCache::release(get(config, files, others[i]).open_file);
+    check("LRU: capacity is kept", files.size() == CAPACITY);
+    check("LRU: the evicted file still held keeps its fd", held.open_file && isOpen(held_fd)
+          && readFd(held_fd) == "d" && !held.open_file->cached);
+    OpenFileCache::release(held.open_file);
+    check("LRU: its release() closes it", !isOpen(held_fd));
+
+    // index: the directory is probed through the cache, then the index file is what is handed over
+    RoutingResult index = get(config, files, "/");
+    check("index: the index file is handed over open", index.status == ROUTE_OK && index.open_file
+          && readFd(index.open_file->fd) == "index");
+    OpenFile* directory = files.acquire(std::string(g_dir) + "/", VALID_MS, INACTIVE_MS);
+    check("index: the directory entry was released", index.open_file && index.open_file->refs == 1
+          && directory->probe.directory && directory->refs == 1);
+    OpenFileCache::release(directory);
+
+    // a response still holding its fd when the cache goes away
+    int index_fd = index.open_file ? index.open_file->fd : -1;
+    {
+        OpenFileCache gone(CAPACITY);
+        RoutingResult kept = get(config, gone, "/e.html");
+        OpenFileCache::release(index.open_file);
+        index = kept;
+        index_fd = kept.open_file ? kept.open_file->fd : -1;
+    }
+    check("destroyed cache: an acquired fd stays open", index.open_file && isOpen(index_fd) && readFd(index_fd) == "e");
+    OpenFileCache::release(index.open_file);
+    check("destroyed cache: release() closes it", !isOpen(index_fd));
+
+    return g_failed ? 1 : 0;
+}
@@ -0,0 +1,176 @@
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include "../Parser.hpp"
+
+// Counts every heap allocation made by the process
+static unsigned long g_allocs = 0;
+
+void* operator new(size_t size) throw(std::bad_alloc) {
+    ++g_allocs;
+    void* p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) throw() {
+    std::free(p);
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// DO: Write a config with one server and `locations` location blocks
+// RETURN: the number of directives written
+static size_t writeConfig(const char* path, size_t locations) {
+    FILE* f = std::fopen(path, "w");
+    if (!f)
+        throw std::runtime_error("Cannot write bench config");
+
+    std::fprintf(f, "server {\n    listen 127.0.0.1:8080;\n    server_name bench.local;\n");
+    for (size_t i = 0; i < locations; ++i)
+        std::fprintf(f, "    location /tenant%lu/static {\n        root /srv/www/tenant%lu;\n"
+                        "        index index.html;\n        methods GET POST;\n        autoindex off;\n    }\n",
+                        (unsigned long)i, (unsigned long)i);
+    std::fprintf(f, "}\n");
+    std::fclose(f);
+    return 3 + locations * 5;
+}
+
+// The parser's cursor before: peek() and get() returned a copy of the Token
+struct CopyingCursor
+{
+    typedef Token Result;
+    const std::vector<Token>& tokens;
+    size_t index;
+
+    CopyingCursor(const std::vector<Token>& all) : tokens(all), index(0) {}
+    Token peek() const { return index < tokens.size() ? tokens[index] : tokens.back(); }
+    Token get() { return index < tokens.size() ? tokens[index++] : tokens.back(); }
+};
+
+// ... and now: references into the tokens
+struct ReferenceCursor
+{
+    typedef const Token& Result;
+    const std::vector<Token>& tokens;
+    size_t index;
+
+    ReferenceCursor(const std::vector<Token>& all) : tokens(all), index(0) {}
+    const Token& peek() const { return index < tokens.size() ? tokens[index] : tokens.back(); }
+    const Token& get() { return index < tokens.size() ? tokens[index++] : tokens.back(); }
+};
+
+// DO: Walk the tokens with the parser's calls (the same peek()/get() per directive and per block)
+    // nothing is built: what is left is the cost of the cursor itself
+// RETURN: the number of directives seen
+template <typename Cursor>
+static size_t walk(Cursor& cursor) {
+    size_t directives = 0;
+    while (cursor.peek().type != END_OF_FILE)
+    {
+        cursor.get(); // server
+        cursor.get(); // {
+        while (cursor.peek().type != BRACE_CLOSE && cursor.peek().type != END_OF_FILE)
+        {
+            typename Cursor::Result key = cursor.get();
+            ++directives;
+            if (key.directive == DIR_LOCATION)
+            {
+                cursor.get(); // path
+                cursor.get(); // {
+                while (cursor.peek().type != BRACE_CLOSE && cursor.peek().type != END_OF_FILE)
+                {
+                    cursor.get();
+                    ++directives;
+                    while (cursor.peek().type == VALUE)
+                        cursor.get();
+                    cursor.get(); // ;
+                }
+            }
+            else
+            {
+                while (cursor.peek().type == VALUE)
+                    cursor.get();
+            }
+            cursor.get(); // ; or }
+        }
+        cursor.get(); // }
+    }
+    return directives;
+}
+
+template <typename Cursor>
+static void walkReport(const char* step, const std::vector<Token>& tokens, size_t directives) {
+    Cursor cursor(tokens);
+    unsigned long a = g_allocs;
+    double t = now();
+    walk(cursor);
+    std::printf("  %-22s %10lu allocs  %6.2f allocs/directive  %8.3f ms\n",
+                step, g_allocs - a, (double)(g_allocs - a) / directives, (now() - t) * 1000);
+}
+
+static void report(const char* step, unsigned long allocs, double seconds, size_t directives) {
+    std::printf("  %-22s %10lu allocs  %6.2f allocs/directive  %8.3f ms\n",
+                step, allocs, (double)allocs / directives, seconds * 1000);
+}
+
+int main(int argc, char* argv[]) {
+    size_t locations = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 100000;
+    const char* path = "/tmp/webserv_bench_parse.conf";
+    size_t directives = writeConfig(path, locations);
+
+    std::printf("%lu location blocks, %lu directives\n", (unsigned long)locations, (unsigned long)directives);
+
+    // the cursor alone, same calls as the parser: by value (before) and by reference (now)
+    {
+        std::printf("token cursor, walking the tokens the way the parser does:\n");
+        Tokenizer tokenizer(path);
+        std::vector<Token> tokens = tokenizer.tokenize();
+        walkReport<CopyingCursor>("by value (before)", tokens, directives);
+        walkReport<ReferenceCursor>("by reference (now)", tokens, directives);
+    }
+
+    // old entry point: tokenize into a vector, then the parser copies it
+    {
+        std::printf("copying parser (Parser(tokenizer.tokenize())):\n");
+        Tokenizer tokenizer(path);
+        unsigned long a = g_allocs;
+        double t = now();
+        std::vector<Token> tokens = tokenizer.tokenize();
+        report("tokenize", g_allocs - a, now() - t, directives);
+
+        a = g_allocs;
+        t = now();
+        Parser parser(tokens);
+        report("construct (copy)", g_allocs - a, now() - t, directives);
+
+        a = g_allocs;
+        t = now();
+        Config config = parser.parse();
+        report("parse", g_allocs - a, now() - t, directives);
+    }
+
+    // the loadConfig path: the parser reads every token in place from the mapped file
+    {
+        std::printf("in-place parser (Parser(tokenizer) over a mapped file):\n");
+        unsigned long a = g_allocs;
+        double t = now();
+        Tokenizer tokenizer(path, true);
+        Parser parser(tokenizer);
+        report("map + construct", g_allocs - a, now() - t, directives);
+
+        a = g_allocs;
+        t = now();
+        Config config = parser.parse();
+        report("parse", g_allocs - a, now() - t, directives);
+    }
+
+    std::remove(path);
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <sys/stat.h>
+#include "../Router.hpp"
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// DO: Build a config with `servers` virtual hosts on one port, `locations` locations each,
+//     all rooted in a small real tree under /tmp so the filesystem probes hit real files
+static Config makeConfig(size_t servers, size_t locations) {
+    mkdir("/tmp/webserv_bench_www", 0755);
+    mkdir("/tmp/webserv_bench_www/static", 0755);
+    FILE* f = std::fopen("/tmp/webserv_bench_www/static/app.js", "w");
+    if (f)
+        std::fclose(f);
+    f = std::fopen("/tmp/webserv_bench_www/index.html", "w");
+    if (f)
+        std::fclose(f);
+
+    Config config;
+    config.servers.resize(servers);
+    for (size_t s = 0; s < servers; ++s)
+    {
+        ServerConfig& server = config.servers[s];
+        HostPort hp;
+        hp.listen_host = "127.0.0.1";
+        hp.listen_port = 8080;
+        server.listens.push_back(hp);
+
+        char name[64];
+        std::sprintf(name, "tenant%lu.example.com", (unsigned long)s);
+        server.server_name.push_back(name);
+        for (size_t l = 0; l < locations; ++l)
+        {
+            LocationConfig loc;
+            char path[64];
+            std::sprintf(path, "/app%lu", (unsigned long)l);
+            loc.path = path;
+            loc.root = "/tmp/webserv_bench_www";
+            loc.index = "index.html";
+            loc.methods = METHOD_GET | METHOD_POST;
+            server.locations.push_back(loc);
+        }
+        LocationConfig legacy;
+        legacy.path = "/legacy";
+        legacy.redirection = "http://example.com/new";
+        legacy.methods = METHOD_GET;
+        server.locations.push_back(legacy);
+    }
+    compileRoutes(config);
+    return config;
+}
+
+// Hits, index hits, 404s and redirects over a few hot hosts
+static std::vector<RouteRequest> makeRequests(size_t count, size_t servers, size_t locations) {
+    static const char* tails[] = { "/static/app.js", "/", "/missing.png", "" };
+    std::vector<RouteRequest> requests(count);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        char host[64];
+        char uri[128];
+        std::sprintf(host, "tenant%lu.example.com", (unsigned long)(std::rand() % (servers < 8 ? servers : 8)));
+        if (std::rand() % 10 == 0)
+            std::sprintf(uri, "/legacy");
+        else
+            std::sprintf(uri, "/app%lu%s", (unsigned long)(std::rand() % locations), tails[std::rand() % 4]);
+        requests[i].host = host;
+        requests[i].port = 8080;
+        requests[i].uri = uri;
+        requests[i].method = METHOD_GET;
+    }
+    return requests;
+}
+
+int main(int argc, char* argv[]) {
+    size_t servers = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 1000;
+    size_t locations = argc > 2 ? std::strtoul(argv[2], NULL, 10) : 100;
+    size_t batch = argc > 3 ? std::strtoul(argv[3], NULL, 10) : 64;
+    size_t total = 200000;
+
+    std::srand(42);
+    Config config = makeConfig(servers, locations);
+    std::vector<RouteRequest> requests = makeRequests(total, servers, locations);
+    std::vector<RoutingResult> results(batch);
+
+    std::printf("%lu servers x %lu locations, %lu requests, batches of %lu\n",
+                (unsigned long)servers, (unsigned long)locations, (unsigned long)total, (unsigned long)batch);
+
+    double t = now();
+    size_t ok = 0;
+    for (size_t i = 0; i < total; ++i)
+    {
+        RoutingResult r = resolveRoute(config, requests[i].host, requests[i].port, requests[i].uri, requests[i].method);
+        ok += (r.status == ROUTE_OK);
+    }
+    double single = now() - t;
+    std::printf("  per request: %10.0f req/s  (%lu ok)\n", total / single, (unsigned long)ok);
+
+    t = now();
+    ok = 0;
+    for (size_t i = 0; i < total; i += batch)
+    {
+        size_t n = total - i < batch ? total - i : batch;
+        routeBatch(config, &requests[i], n, &results[0]);
+        for (size_t k = 0; k < n; ++k)
+            ok += (results[k].status == ROUTE_OK);
+    }
+    double batched = now() - t;
+    std::printf("  batched:     %10.0f req/s  (%lu ok)  x%.2f\n", total / batched, (unsigned long)ok, single / batched);
+    return 0;
+}
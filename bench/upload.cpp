@@ -0,0 +1,188 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include "../Upload.hpp"
+
+// upload [megabytes]
+    // a local client sends POST bodies over TCP loopback, the server side streams them with Upload:
+    // fixed length (splice), chunked (buffer + pwrite), and one over max_body_size (rejected unread),
+    // then the refusals: a name already taken (409) and a chunk extension past its cap (400)
+    // prints MB/s and the peak RSS, which must not grow with the body size
+
+static const char* g_dir = "/tmp/webserv_bench_upload";
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long peakRss() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+struct Client
+{
+    int port;
+    unsigned long long bytes;
+    bool chunked;
+    size_t extension;  // bytes of chunk extension sent with each chunk
+};
+
+static bool sendAll(int fd, const char* data, size_t length) {
+    while (length)
+    {
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+// The client: connects and sends the body, the way a browser or curl would
+static void* client(void* arg) {
+    const Client& c = *static_cast<Client*>(arg);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(c.port);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    static char block[256 * 1024];
+    std::memset(block, 'x', sizeof(block));
+    unsigned long long left = c.bytes;
+    while (left)
+    {
+        size_t n = left < sizeof(block) ? left : sizeof(block);
+        if (c.chunked)
+        {
+            char size[32];
+            std::sprintf(size, "%lx", (unsigned long)n);
+            std::string line = size;
+            if (c.extension)
+                line += ";" + std::string(c.extension - 1, 'x');
+            line += "\r\n";
+            if (!sendAll(fd, line.data(), line.size()))
+                break;
+        }
+        if (!sendAll(fd, block, n) || (c.chunked && !sendAll(fd, "\r\n", 2)))
+            break;
+        left -= n;
+    }
+    if (c.chunked)
+        sendAll(fd, "0\r\n\r\n", 5);
+    // wait for the server to close: the body was taken (or refused)
+    char end;
+    while (recv(fd, &end, 1, 0) > 0)
+        ;
+    close(fd);
+    return NULL;
+}
+
+static int listenLoopback(int& port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    socklen_t length = sizeof(addr);
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 4) != 0
+        || getsockname(fd, (struct sockaddr*)&addr, &length) != 0)
+        throw std::runtime_error("Cannot listen on loopback");
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+// DO: One upload end to end: accept, start (headers already parsed), pump until done
+static void run(const char* name, const RoutingResult& route, const char* uri,
+                        unsigned long long bytes, bool chunked, long long content_length, size_t extension = 0)
+{
+    int port;
+    int server = listenLoopback(port);
+    Client c;
+    c.port = port;
+    c.bytes = bytes;
+    c.chunked = chunked;
+    c.extension = extension;
+    pthread_t thread;
+    pthread_create(&thread, NULL, client, &c);
+
+    int socket = accept(server, NULL, NULL);
+    fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+
+    double t = now();
+    Upload upload;
+    UploadStatus status = upload.start(route, uri, content_length, chunked);
+    while (status == UPLOAD_MORE)
+    {
+        struct pollfd p;
+        p.fd = socket;
+        p.events = POLLIN;
+        poll(&p, 1, 5000);
+        status = upload.pump(socket);
+    }
+    t = now() - t;
+    close(socket);
+    pthread_join(thread, NULL);
+    close(server);
+
+    struct stat s;
+    bool stored = (status == UPLOAD_DONE && stat(upload.path().c_str(), &s) == 0 && (unsigned long long)s.st_size == bytes);
+    std::printf("  %-10s %6d  %8.1f MB  %8.1f MB/s  %s\n", name, uploadStatusCode(status), upload.received() / 1e6,
+                upload.received() / 1e6 / t, status == UPLOAD_DONE ? (stored ? "stored" : "SIZE MISMATCH") : "refused");
+    if (status == UPLOAD_DONE)
+        unlink(upload.path().c_str());
+}
+
+int main(int argc, char* argv[]) {
+    unsigned long long megabytes = argc > 1 ? std::strtoull(argv[1], NULL, 10) : 1024;
+    unsigned long long bytes = megabytes * 1000 * 1000;
+
+    mkdir(g_dir, 0755);
+    Config config;
+    config.servers.resize(1);
+    ServerConfig& server = config.servers[0];
+    server.max_body_size = bytes;
+    LocationConfig loc;
+    loc.path = "/upload";
+    loc.root = g_dir;
+    loc.upload_dir = g_dir;
+    loc.methods = METHOD_POST;
+    server.locations.push_back(loc);
+    compileRoutes(config);
+
+    RoutingResult route;
+    route.server = &config.servers[0];
+    route.location = &config.servers[0].locations[0];
+
+    std::printf("%llu MB bodies, peak RSS before: %ld KiB\n", megabytes, peakRss());
+    run("fixed", route, "/upload/fixed.bin", bytes, false, bytes);
+    run("chunked", route, "/upload/chunked.bin", bytes, true, -1);
+    run("too large", route, "/upload/big.bin", 0, false, bytes + 1);
+    std::string taken = std::string(g_dir) + "/taken.bin";
+    close(open(taken.c_str(), O_WRONLY | O_CREAT, 0644));
+    run("conflict", route, "/upload/taken.bin", 1000, false, 1000);
+    unlink(taken.c_str());
+    run("extension", route, "/upload/extension.bin", 1000, true, -1, Upload::MAX_EXTENSION + 1);
+    std::printf("peak RSS after: %ld KiB\n", peakRss());
+    return 0;
+}
@@ -2,6 +2,7 @@
 #include "Tokenizer.hpp"
 #include "Parser.hpp"
 #include "Router.hpp"
+#include "ConfigCache.hpp"
 
 int main(int argc, char* argv[]) {
     if (argc != 2) {
@@ -10,15 +11,13 @@ int main(int argc, char* argv[]) {
     }
 
     try {
-        Tokenizer tokenizer(argv[1]);
-        Parser parser(tokenizer.tokenize());
-        Config config = parser.parse();
+        Config config = loadConfig(argv[1]);
 
         RoutingResult result = routingResult(config, "localhost", 8080, "/docs/index.html", "DELETE");
 
         std::cout << "Server count: " << result.server_count << std::endl;
         if (result.is_redirect)
-            std::cout << "Redirect to: " << result.redirect_url << std::endl;
+            std::cout << "Redirect to: " << result.redirect_url.str() << std::endl;
         else if (result.use_autoindex)
             std::cout << "Autoindex enabled for: " << result.file_path << std::endl;
         else